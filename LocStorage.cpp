@@ -11,16 +11,69 @@
 #include "eep_cfg.h"
 #include <Arduino.h>
 
-#if APP_CFG_UC == APP_CFG_UC_ESP8266
-#include <EEPROM.h>
-#include <spi_flash.h>
-#else
-#include <Wire.h>
-#endif
-
 /***********************************************************************************************************************
    D E F I N E S
  **********************************************************************************************************************/
+/* Wear leveling rings for often written values, located at the end of the EEPROM. An entry contains a sequence
+ * number, a 16 bit value and a check byte. */
+#define LOC_STORAGE_RING_SELECTED_LOC_ADDRESS (LocStorageBackend::Size - LOC_STORAGE_RING_SIZE)
+
+/* Occupation bitmap of the loc slots, below the rings. */
+#define LOC_STORAGE_SLOT_MAP_ADDRESS (LOC_STORAGE_RING_SELECTED_LOC_ADDRESS - LOC_STORAGE_SLOT_MAP_SIZE)
+
+/* Header with layout version of the data maintained by LocStorage, below the slot map. */
+#define LOC_STORAGE_HEADER_ADDRESS (LOC_STORAGE_SLOT_MAP_ADDRESS - LOC_STORAGE_HEADER_SIZE)
+#define LOC_STORAGE_HEADER_LAYOUT 0    /* Layout version, 0xFF (never written) for the legacy layout. */
+#define LOC_STORAGE_HEADER_MIGRATION 1 /* Source layout of a running migration, 0xFF when no migration runs. */
+#define LOC_STORAGE_HEADER_NEXT_SLOT 2 /* Next slot to migrate, 2 bytes little endian. */
+#define LOC_STORAGE_HEADER_STASHED 4   /* Record of next slot to migrate is in the stash. */
+#define LOC_STORAGE_HEADER_MAP_VALID 5 /* Slot map written. */
+#define LOC_STORAGE_HEADER_BUTTONS 6   /* Function buttons of the packed records, 0xFF for 5 (older headers). */
+#define LOC_STORAGE_HEADER_NAME 7      /* Name length of the packed records, 0xFF for 10 (older headers). */
+#define LOC_STORAGE_HEADER_USED 8      /* Bytes of header in use before the stash. */
+#define LOC_STORAGE_HEADER_STASH 32    /* Copy of a raw record during migration, up to 32 bytes. */
+
+/* Table with the functions above F31 of locs which have one of these functions on, below the header. An entry
+ * belongs to a loc address, so a loc moved to another slot keeps its entry. The slot is only used to free the entry
+ * when the loc is removed, an unused entry is erased. Multi byte values little endian:
+ *  0  Loc address (2)
+ *  2  Slot (2)
+ *  4  Functions F32..F71 (5)
+ *  9  Check byte (1) */
+#define LOC_STORAGE_EXT_ADDRESS (LOC_STORAGE_HEADER_ADDRESS - LOC_STORAGE_EXT_SIZE)
+#define LOC_STORAGE_EXT_FUNCTIONS 4
+#define LOC_STORAGE_EXT_FREE 0xFFFF
+
+#define LOC_STORAGE_LAYOUT_LEGACY 0   /* Raw records, number of locs instead of slot map. */
+#define LOC_STORAGE_LAYOUT_SLOT_MAP 1 /* Raw records, slot map. */
+#define LOC_STORAGE_LAYOUT_PACKED 2   /* Packed records, slot map. */
+#define LOC_STORAGE_LAYOUT_VERSION LOC_STORAGE_LAYOUT_PACKED
+
+/* Packed record, multi byte values little endian:
+ *  0  Address (2)
+ *  2  Speed (1)
+ *  3  Flags (1), bit 0 direction, bit 1..2 decoder steps, bit 3 functions above F31 present
+ *  4  Functions F0..F31 (4)
+ *  8  Function assignment (LOC_LIB_FUNCTION_BUTTONS, 5 by default)
+ * 13  Name (LOC_LIB_NAME_LENGTH, 10 by default), not zero terminated when it has the max length
+ * 23  Functions F32..F71 (5), only when flag bit 3 is set. In EEPROM these are kept in the table below the header,
+ *     so the records of locs without these functions do not grow.
+ * The offsets are those of the default configuration, the header holds the configuration of the stored records. */
+#define LOC_STORAGE_RECORD_DIR 0x01
+#define LOC_STORAGE_RECORD_EXT 0x08
+#define LOC_STORAGE_RECORD_STEPS_SHIFT 1
+#define LOC_STORAGE_RECORD_STEPS_MASK 0x03
+#define LOC_STORAGE_RECORD_BUTTONS 8
+#define LOC_STORAGE_RECORD_NAME (LOC_STORAGE_RECORD_BUTTONS + LOC_LIB_FUNCTION_BUTTONS)
+
+/* Requirements on the backend, see LocStorageBackend.h. */
+static_assert(LocStorageBackend::Size <= 65536, "Addresses of the backend must fit in 16 bits.");
+static_assert((LocStorageBackend::RecordBase + LOC_STORAGE_ADMIN_SIZE) < LocStorageBackend::Size,
+    "Administration data does not fit above the record base.");
+static_assert(LocStorageBackend::RecordStride >= LOC_STORAGE_RECORD_SIZE, "Record stride smaller than a record.");
+static_assert(LocStorageBackend::LegacyRecordStride >= sizeof(LocLibDataLegacy), "Legacy stride smaller than record.");
+static_assert(LocStorage::SlotsMax > 0, "No loc record fits in the memory of the backend.");
+static_assert(LOC_STORAGE_RECORD_SIZE_MAX <= 255, "Name length or function buttons too large for a record.");
 
 /***********************************************************************************************************************
    F O R W A R D  D E C L A R A T I O N S
@@ -29,114 +82,460 @@
 /***********************************************************************************************************************
    D A T A   D E C L A R A T I O N S (exported, local)
  **********************************************************************************************************************/
+/**
+ * Administration of a wear leveling ring.
+ */
+struct StorageRing
+{
+    unsigned int Address; /* Start address of ring in EEPROM. */
+    bool Scanned;         /* Ring searched for newest entry. */
+    bool Valid;           /* Ring contains a valid entry. */
+    uint8_t Position;     /* Position of newest entry. */
+    uint8_t Sequence;     /* Sequence number of newest entry. */
+    uint16_t Value;       /* Value of newest entry. */
+};
+
+static StorageRing SelectedLocRing = { LOC_STORAGE_RING_SELECTED_LOC_ADDRESS, false, false, 0, 0, 0 };
+static bool MapValid; /* Header with actual layout version and valid slot map present. */
+
+/**
+ * Owners of the entries in the table with the functions above F31.
+ */
+struct StorageExtTable
+{
+    bool Scanned;                              /* Table read from EEPROM. */
+    uint16_t Address[LOC_STORAGE_EXT_ENTRIES]; /* Loc of each entry, LOC_STORAGE_EXT_FREE when unused. */
+    uint16_t Slot[LOC_STORAGE_EXT_ENTRIES];    /* Slot of the loc of each entry. */
+};
+
+static StorageExtTable ExtTable;
+
+#if LOC_STORAGE_CACHE_ENTRIES > 0
+/**
+ * Decoded loc record in the cache.
+ */
+struct StorageCacheEntry
+{
+    uint16_t Slot;   /* Slot of the record, 0xFFFF when the entry is unused. */
+    LocLibData Data; /* Decoded record. */
+};
+
+static StorageCacheEntry Cache[LOC_STORAGE_CACHE_ENTRIES]; /* Most recently used entry first. */
+#endif
+static LocStorageCacheStats CacheStats; /* Hits and misses of the cache. */
 
 /***********************************************************************************************************************
   F U N C T I O N S
  **********************************************************************************************************************/
 
 /***********************************************************************************************************************
+ * Check byte of a ring entry, an erased entry (all 0xFF) is never valid.
  */
-#if APP_CFG_UC == APP_CFG_UC_STM32
-void i2c_eeprom_write_byte(int deviceaddress, unsigned int eeaddress, byte data)
+static uint8_t ring_entry_check(const uint8_t* entry) { return ((uint8_t)(entry[0] ^ entry[1] ^ entry[2] ^ 0x5A)); }
+
+/***********************************************************************************************************************
+ * Read all entries of a ring and search the newest entry. Entries are written with incrementing sequence numbers,
+ * the newest entry is the valid entry not followed by a valid entry with the next sequence number.
+ */
+static void ring_scan(LocStorageBackend* Backend, StorageRing* Ring)
 {
-    int rdata = data;
-    Wire.beginTransmission(deviceaddress);
-    Wire.write((int)(eeaddress >> 8));   // MSB
-    Wire.write((int)(eeaddress & 0xFF)); // LSB
-    Wire.write(rdata);
-    Wire.endTransmission();
-    delay(100);
+    uint8_t Entries[LOC_STORAGE_RING_SIZE];
+    uint8_t* Entry;
+    uint8_t* Next;
+    uint16_t Index;
+
+    Backend->Read(Ring->Address, Entries, sizeof(Entries));
+
+    Ring->Scanned  = true;
+    Ring->Valid    = false;
+    Ring->Position = LOC_STORAGE_RING_ENTRIES - 1;
+    Ring->Sequence = 0xFF;
+
+    for (Index = 0; Index < LOC_STORAGE_RING_ENTRIES; Index++)
+    {
+        Entry = &Entries[Index * LOC_STORAGE_RING_ENTRY_SIZE];
+        Next  = &Entries[((Index + 1) % LOC_STORAGE_RING_ENTRIES) * LOC_STORAGE_RING_ENTRY_SIZE];
+
+        if (ring_entry_check(Entry) == Entry[3])
+        {
+            if ((ring_entry_check(Next) != Next[3]) || (Next[0] != (uint8_t)(Entry[0] + 1)))
+            {
+                Ring->Valid    = true;
+                Ring->Position = Index;
+                Ring->Sequence = Entry[0];
+                Ring->Value    = (uint16_t)(Entry[1]) | ((uint16_t)(Entry[2]) << 8);
+                break;
+            }
+        }
+    }
 }
 
 /***********************************************************************************************************************
+ * Get the newest value of a ring.
  */
-void i2c_eeprom_write_page(int deviceaddress, unsigned int eeaddresspage, byte* data, byte length)
+static bool ring_read(LocStorageBackend* Backend, StorageRing* Ring, uint16_t* Value)
 {
-    Wire.beginTransmission(deviceaddress);
-    Wire.write((int)(eeaddresspage >> 8));   // MSB
-    Wire.write((int)(eeaddresspage & 0xFF)); // LSB
-    byte c;
-    for (c = 0; c < length; c++)
-        Wire.write(data[c]);
-    Wire.endTransmission();
-    delay(100);
+    if (Ring->Scanned == false)
+    {
+        ring_scan(Backend, Ring);
+    }
+
+    *Value = Ring->Value;
+    return (Ring->Valid);
 }
 
 /***********************************************************************************************************************
+ * Append a value to a ring, the write is skipped when the value is not changed.
  */
-byte i2c_eeprom_read_byte(int deviceaddress, unsigned int eeaddress)
+static void ring_write(LocStorageBackend* Backend, StorageRing* Ring, uint16_t Value)
 {
-    byte rdata = 0xFF;
-    Wire.beginTransmission(deviceaddress);
-    Wire.write((int)(eeaddress >> 8));   // MSB
-    Wire.write((int)(eeaddress & 0xFF)); // LSB
-    Wire.endTransmission();
-    Wire.requestFrom(deviceaddress, 1);
-    if (Wire.available()) rdata = Wire.read();
-    return rdata;
+    uint8_t Entry[LOC_STORAGE_RING_ENTRY_SIZE];
+    unsigned int Address;
+
+    if (Ring->Scanned == false)
+    {
+        ring_scan(Backend, Ring);
+    }
+
+    if ((Ring->Valid == false) || (Ring->Value != Value))
+    {
+        Ring->Position = (Ring->Position + 1) % LOC_STORAGE_RING_ENTRIES;
+        Ring->Sequence++;
+        Ring->Value = Value;
+        Ring->Valid = true;
+
+        Entry[0] = Ring->Sequence;
+        Entry[1] = (uint8_t)(Value & 0xFF);
+        Entry[2] = (uint8_t)(Value >> 8);
+        Entry[3] = ring_entry_check(Entry);
+
+        Address = Ring->Address + (Ring->Position * LOC_STORAGE_RING_ENTRY_SIZE);
+        Backend->Write(Address, Entry, LOC_STORAGE_RING_ENTRY_SIZE);
+        Backend->Commit();
+    }
 }
-#endif
 
 /***********************************************************************************************************************
+ * Check byte of an entry of the table with the functions above F31, an erased entry (all 0xFF) is never valid.
  */
-void LocStorage::Init()
+static uint8_t ext_entry_check(const uint8_t* entry)
 {
-#if APP_CFG_UC == APP_CFG_UC_ESP8266
-    EEPROM.begin(SPI_FLASH_SEC_SIZE * 2);
-#else
-    I2CAddressAT24C256 = 0x50;
-    Wire.begin();
-#endif
+    uint8_t check = 0x5A;
+    uint8_t index;
+
+    for (index = 0; index < (LOC_STORAGE_EXT_ENTRY_SIZE - 1); index++)
+    {
+        check ^= entry[index];
+    }
+
+    return (check);
 }
 
 /***********************************************************************************************************************
+ * Get the table entry of a loc address, LOC_STORAGE_EXT_ENTRIES when the loc has no entry. The owners of the entries
+ * are read once, after that the table is only accessed for the entry of a loc.
  */
-bool LocStorage::VersionCheck()
+static uint8_t ext_find(LocStorageBackend* Backend, uint16_t LocAddress)
 {
-    uint8_t Version = 255;
-    bool Result     = true;
+    uint8_t Entries[LOC_STORAGE_EXT_SIZE];
+    uint8_t* Entry;
+    uint8_t Index;
 
-#if APP_CFG_UC == APP_CFG_UC_STM32
-    Version = (uint8_t)(i2c_eeprom_read_byte(I2CAddressAT24C256, EepCfg::EepromVersionAddress));
-#elif APP_CFG_UC == APP_CFG_UC_ESP8266
-    Version = EEPROM.read(EepCfg::EepromVersionAddress);
-#endif
+    if (ExtTable.Scanned == false)
+    {
+        Backend->Read(LOC_STORAGE_EXT_ADDRESS, Entries, sizeof(Entries));
+        for (Index = 0; Index < LOC_STORAGE_EXT_ENTRIES; Index++)
+        {
+            Entry                   = &Entries[Index * LOC_STORAGE_EXT_ENTRY_SIZE];
+            ExtTable.Address[Index] = LOC_STORAGE_EXT_FREE;
+            if (ext_entry_check(Entry) == Entry[LOC_STORAGE_EXT_ENTRY_SIZE - 1])
+            {
+                ExtTable.Address[Index] = (uint16_t)(Entry[0]) | ((uint16_t)(Entry[1]) << 8);
+                ExtTable.Slot[Index]    = (uint16_t)(Entry[2]) | ((uint16_t)(Entry[3]) << 8);
+            }
+        }
+        ExtTable.Scanned = true;
+    }
 
-    if (Version != EepCfg::EepromVersion)
+    for (Index = 0; Index < LOC_STORAGE_EXT_ENTRIES; Index++)
+    {
+        if (ExtTable.Address[Index] == LocAddress)
+        {
+            break;
+        }
+    }
+
+    return (Index);
+}
+
+/***********************************************************************************************************************
+ * Erase a table entry, so it can be used for another loc.
+ */
+static void ext_free(LocStorageBackend* Backend, uint8_t Index)
+{
+    uint8_t Entry[LOC_STORAGE_EXT_ENTRY_SIZE];
+
+    memset(Entry, 0xFF, sizeof(Entry));
+    Backend->Write(LOC_STORAGE_EXT_ADDRESS + (Index * LOC_STORAGE_EXT_ENTRY_SIZE), Entry, sizeof(Entry));
+    ExtTable.Address[Index] = LOC_STORAGE_EXT_FREE;
+}
+
+/***********************************************************************************************************************
+ * Store the functions above F31 of a packed record in the table entry of its loc. A new entry is only taken when the
+ * loc has no entry yet, an entry is only written when its content changes. Returns false when the table is full.
+ */
+static bool ext_write(LocStorageBackend* Backend, uint16_t Slot, const uint8_t* Record)
+{
+    uint8_t Entry[LOC_STORAGE_EXT_ENTRY_SIZE];
+    uint8_t Stored[LOC_STORAGE_EXT_ENTRY_SIZE];
+    uint16_t Address;
+    uint8_t Index = ext_find(Backend, (uint16_t)(Record[0]) | ((uint16_t)(Record[1]) << 8));
+    bool Result   = true;
+
+    if (Index == LOC_STORAGE_EXT_ENTRIES)
+    {
+        Index = ext_find(Backend, LOC_STORAGE_EXT_FREE);
+    }
+
+    if (Index == LOC_STORAGE_EXT_ENTRIES)
     {
-        EraseEeprom();
-#if APP_CFG_UC == APP_CFG_UC_STM32
-        i2c_eeprom_write_byte(I2CAddressAT24C256, EepCfg::EepromVersionAddress, (byte)(EepCfg::EepromVersion));
-#elif APP_CFG_UC == APP_CFG_UC_ESP8266
-        EEPROM.write(EepCfg::EepromVersionAddress, EepCfg::EepromVersion);
-        EEPROM.commit();
-#endif
         Result = false;
     }
+    else
+    {
+        Entry[0] = Record[0];
+        Entry[1] = Record[1];
+        Entry[2] = (uint8_t)(Slot & 0xFF);
+        Entry[3] = (uint8_t)(Slot >> 8);
+        memcpy(&Entry[LOC_STORAGE_EXT_FUNCTIONS], &Record[LOC_STORAGE_RECORD_SIZE], LOC_STORAGE_RECORD_EXT_SIZE);
+        Entry[LOC_STORAGE_EXT_ENTRY_SIZE - 1] = ext_entry_check(Entry);
+
+        Address = LOC_STORAGE_EXT_ADDRESS + (Index * LOC_STORAGE_EXT_ENTRY_SIZE);
+        Backend->Read(Address, Stored, sizeof(Stored));
+        if (memcmp(Entry, Stored, sizeof(Entry)) != 0)
+        {
+            Backend->Write(Address, Entry, sizeof(Entry));
+        }
+        ExtTable.Address[Index] = (uint16_t)(Record[0]) | ((uint16_t)(Record[1]) << 8);
+        ExtTable.Slot[Index]    = Slot;
+    }
 
     return (Result);
 }
 
-#if APP_CFG_UC == APP_CFG_UC_STM32
+#if LOC_STORAGE_CACHE_ENTRIES > 0
 /***********************************************************************************************************************
+ * Get the cache entry of a slot, LOC_STORAGE_CACHE_ENTRIES when the slot is not cached.
  */
-uint8_t LocStorage::XpNetAddressGet(void)
+static uint8_t cache_find(uint16_t Slot)
 {
-    uint8_t XpNetAddress;
+    uint8_t Entry;
 
-    XpNetAddress = (uint8_t)(i2c_eeprom_read_byte(I2CAddressAT24C256, EepCfg::XpNetAddress));
+    for (Entry = 0; Entry < LOC_STORAGE_CACHE_ENTRIES; Entry++)
+    {
+        if (Cache[Entry].Slot == Slot)
+        {
+            break;
+        }
+    }
 
-    return (XpNetAddress);
+    return (Entry);
 }
 
 /***********************************************************************************************************************
+ * Make a cache entry the most recently used entry, the entries before it move one position back.
  */
-void LocStorage::XpNetAddressSet(uint8_t XpNetAddress)
+static void cache_use(uint8_t Entry)
 {
-    i2c_eeprom_write_byte(I2CAddressAT24C256, EepCfg::XpNetAddress, (byte)(XpNetAddress));
+    StorageCacheEntry Used;
+
+    if (Entry > 0)
+    {
+        memcpy(&Used, &Cache[Entry], sizeof(StorageCacheEntry));
+        memmove(&Cache[1], &Cache[0], Entry * sizeof(StorageCacheEntry));
+        memcpy(&Cache[0], &Used, sizeof(StorageCacheEntry));
+    }
 }
 #endif
 
+/***********************************************************************************************************************
+ * Forget all cached records, after the records were changed without LocDataSet().
+ */
+static void cache_invalidate(void)
+{
+#if LOC_STORAGE_CACHE_ENTRIES > 0
+    uint8_t Entry;
+
+    for (Entry = 0; Entry < LOC_STORAGE_CACHE_ENTRIES; Entry++)
+    {
+        Cache[Entry].Slot = 0xFFFF;
+    }
+#endif
+}
+
+/***********************************************************************************************************************
+ * Check if the packed records described by the header have the configured name length and function buttons.
+ */
+static bool header_format_match(const uint8_t* Header)
+{
+    uint8_t Buttons = Header[LOC_STORAGE_HEADER_BUTTONS];
+    uint8_t Name    = Header[LOC_STORAGE_HEADER_NAME];
+
+    /* Headers written before these fields existed describe records of the default configuration. */
+    if (Buttons == 0xFF)
+    {
+        Buttons = 5;
+    }
+    if (Name == 0xFF)
+    {
+        Name = 10;
+    }
+
+    return ((Buttons == LOC_LIB_FUNCTION_BUTTONS) && (Name == LOC_LIB_NAME_LENGTH));
+}
+
+/***********************************************************************************************************************
+ * Convert a raw record of an older layout.
+ */
+static void legacy_convert(const LocLibDataLegacy* Legacy, LocLibData* DataPtr)
+{
+    uint8_t Button;
+    uint8_t Length;
+
+    memset(DataPtr, 0, sizeof(LocLibData));
+    DataPtr->Addres = Legacy->Addres;
+    DataPtr->Speed  = Legacy->Speed;
+    DataPtr->Dir    = Legacy->Dir;
+    DataPtr->Steps  = Legacy->Steps;
+    DataPtr->Function.LowSet(Legacy->Function);
+
+    /* Buttons which the raw record does not have get the default assignment, names are cut to the name length. */
+    for (Button = 0; Button < LOC_LIB_FUNCTION_BUTTONS; Button++)
+    {
+        DataPtr->FunctionAssignment[Button]
+            = (Button < sizeof(Legacy->FunctionAssignment)) ? Legacy->FunctionAssignment[Button] : Button;
+    }
+    Length = (sizeof(Legacy->Name) < sizeof(DataPtr->Name)) ? sizeof(Legacy->Name) : sizeof(DataPtr->Name);
+    memcpy(DataPtr->Name, Legacy->Name, Length - 1);
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorage::RecordEncode(const LocLibData* DataPtr, uint8_t* Record)
+{
+    uint8_t Index;
+
+    Record[0] = (uint8_t)(DataPtr->Addres & 0xFF);
+    Record[1] = (uint8_t)(DataPtr->Addres >> 8);
+    Record[2] = (uint8_t)(DataPtr->Speed);
+    Record[3]
+        = (uint8_t)(((uint8_t)(DataPtr->Steps) & LOC_STORAGE_RECORD_STEPS_MASK) << LOC_STORAGE_RECORD_STEPS_SHIFT);
+    if (DataPtr->Dir == directionBackWard)
+    {
+        Record[3] |= LOC_STORAGE_RECORD_DIR;
+    }
+    memcpy(&Record[4], &DataPtr->Function.Bits[0], 4);
+    memcpy(&Record[LOC_STORAGE_RECORD_BUTTONS], DataPtr->FunctionAssignment, sizeof(DataPtr->FunctionAssignment));
+    memcpy(&Record[LOC_STORAGE_RECORD_NAME], DataPtr->Name, sizeof(DataPtr->Name) - 1);
+
+    memcpy(&Record[LOC_STORAGE_RECORD_SIZE], &DataPtr->Function.Bits[4], LOC_STORAGE_RECORD_EXT_SIZE);
+    for (Index = LOC_STORAGE_RECORD_SIZE; Index < LOC_STORAGE_RECORD_SIZE_MAX; Index++)
+    {
+        if (Record[Index] != 0)
+        {
+            Record[3] |= LOC_STORAGE_RECORD_EXT;
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorage::RecordDecode(const uint8_t* Record, LocLibData* DataPtr)
+{
+    uint8_t Steps = (Record[3] >> LOC_STORAGE_RECORD_STEPS_SHIFT) & LOC_STORAGE_RECORD_STEPS_MASK;
+
+    DataPtr->Addres   = (uint16_t)(Record[0]) | ((uint16_t)(Record[1]) << 8);
+    DataPtr->Speed    = Record[2];
+    DataPtr->Dir      = ((Record[3] & LOC_STORAGE_RECORD_DIR) != 0) ? directionBackWard : directionForward;
+    DataPtr->Steps    = (Steps <= decoderStep128) ? (decoderSteps)(Steps) : decoderStep28;
+    memcpy(&DataPtr->Function.Bits[0], &Record[4], 4);
+    memcpy(DataPtr->FunctionAssignment, &Record[LOC_STORAGE_RECORD_BUTTONS], sizeof(DataPtr->FunctionAssignment));
+    memcpy(DataPtr->Name, &Record[LOC_STORAGE_RECORD_NAME], sizeof(DataPtr->Name) - 1);
+    DataPtr->Name[sizeof(DataPtr->Name) - 1] = '\0';
+
+    if ((Record[3] & LOC_STORAGE_RECORD_EXT) != 0)
+    {
+        memcpy(&DataPtr->Function.Bits[4], &Record[LOC_STORAGE_RECORD_SIZE], LOC_STORAGE_RECORD_EXT_SIZE);
+    }
+    else
+    {
+        memset(&DataPtr->Function.Bits[4], 0, LOC_STORAGE_RECORD_EXT_SIZE);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t LocStorage::RecordSize(const uint8_t* Record)
+{
+    return (((Record[3] & LOC_STORAGE_RECORD_EXT) != 0) ? LOC_STORAGE_RECORD_SIZE_MAX : LOC_STORAGE_RECORD_SIZE);
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorage::Init()
+{
+    /* Cached state of the EEPROM content is read again. */
+    SelectedLocRing.Scanned = false;
+    ExtTable.Scanned        = false;
+    MapValid                = false;
+    m_Transaction           = false;
+    cache_invalidate();
+
+    m_Backend.Init();
+}
+
+/***********************************************************************************************************************
+ */
+bool LocStorage::VersionCheck()
+{
+    uint8_t Version;
+    bool Result = true;
+
+    Version = ByteRead(EepCfg::EepromVersionAddress);
+
+    /* Loc data in a known layout survives a new EEPROM version, it is converted to the actual layout. Without a
+     * header the loc data can not be identified, so it is only converted when the version is unchanged. */
+    if ((Version != EepCfg::EepromVersion) && (LayoutGet() == LOC_STORAGE_LAYOUT_LEGACY))
+    {
+        Result = false;
+    }
+    else
+    {
+        Result = LayoutMigrate();
+    }
+
+    if (Result == false)
+    {
+        EraseEeprom();
+    }
+    if (Version != EepCfg::EepromVersion)
+    {
+        ByteWrite(EepCfg::EepromVersionAddress, EepCfg::EepromVersion);
+    }
+
+    return (Result);
+}
+
+#if APP_CFG_UC == APP_CFG_UC_STM32
+/***********************************************************************************************************************
+ */
+uint8_t LocStorage::XpNetAddressGet(void) { return (ByteRead(EepCfg::XpNetAddress)); }
+
+/***********************************************************************************************************************
+ */
+void LocStorage::XpNetAddressSet(uint8_t XpNetAddress) { ByteWrite(EepCfg::XpNetAddress, XpNetAddress); }
+#endif
+
 /***********************************************************************************************************************
  */
 bool LocStorage::AcOptionGet()
@@ -144,11 +543,7 @@ bool LocStorage::AcOptionGet()
     bool Result = false;
     uint8_t AcOptionEep;
 
-#if APP_CFG_UC == APP_CFG_UC_STM32
-    AcOptionEep = (uint8_t)(i2c_eeprom_read_byte(I2CAddressAT24C256, EepCfg::AcTypeControlAddress));
-#elif APP_CFG_UC == APP_CFG_UC_ESP8266
-    AcOptionEep = EEPROM.read(EepCfg::AcTypeControlAddress);
-#endif
+    AcOptionEep = ByteRead(EepCfg::AcTypeControlAddress);
 
     /* Check AC option.*/
     switch (AcOptionEep)
@@ -162,27 +557,11 @@ bool LocStorage::AcOptionGet()
 
 /***********************************************************************************************************************
  */
-void LocStorage::AcOptionSet(uint8_t acOption)
-{
-#if APP_CFG_UC == APP_CFG_UC_STM32
-    i2c_eeprom_write_byte(I2CAddressAT24C256, EepCfg::AcTypeControlAddress, (byte)(acOption));
-#elif APP_CFG_UC == APP_CFG_UC_ESP8266
-    EEPROM.write(EepCfg::AcTypeControlAddress, acOption);
-    EEPROM.commit();
-#endif
-}
+void LocStorage::AcOptionSet(uint8_t acOption) { ByteWrite(EepCfg::AcTypeControlAddress, acOption); }
 
 /***********************************************************************************************************************
  */
-void LocStorage::EmergencyOptionSet(uint8_t emergency)
-{
-#if APP_CFG_UC == APP_CFG_UC_STM32
-    i2c_eeprom_write_byte(I2CAddressAT24C256, EepCfg::EmergencyStopEnabledAddress, (byte)(emergency));
-#elif APP_CFG_UC == APP_CFG_UC_ESP8266
-    EEPROM.write(EepCfg::EmergencyStopEnabledAddress, emergency);
-    EEPROM.commit();
-#endif
-}
+void LocStorage::EmergencyOptionSet(uint8_t emergency) { ByteWrite(EepCfg::EmergencyStopEnabledAddress, emergency); }
 
 /***********************************************************************************************************************
  */
@@ -191,11 +570,7 @@ bool LocStorage::EmergencyOptionGet(void)
     bool Result = false;
     uint8_t emergencyActive;
 
-#if APP_CFG_UC == APP_CFG_UC_STM32
-    emergencyActive = (uint8_t)(i2c_eeprom_read_byte(I2CAddressAT24C256, EepCfg::EmergencyStopEnabledAddress));
-#elif APP_CFG_UC == APP_CFG_UC_ESP8266
-    emergencyActive = EEPROM.read(EepCfg::EmergencyStopEnabledAddress);
-#endif
+    emergencyActive = ByteRead(EepCfg::EmergencyStopEnabledAddress);
 
     /* Check AC option.*/
     switch (emergencyActive)
@@ -209,53 +584,108 @@ bool LocStorage::EmergencyOptionGet(void)
 
 /***********************************************************************************************************************
  */
-uint8_t LocStorage::NumberOfLocsGet()
+uint8_t LocStorage::NumberOfLocsGet() { return (ByteRead(EepCfg::locLibEepromAddressNumOfLocs)); }
+
+/***********************************************************************************************************************
+ */
+void LocStorage::NumberOfLocsSet(uint8_t numberOfLocs) { ByteWrite(EepCfg::locLibEepromAddressNumOfLocs, numberOfLocs); }
+
+/***********************************************************************************************************************
+ */
+bool LocStorage::LocDataGet(LocLibData* DataPtr, uint16_t Index)
 {
-    uint8_t NumOfLocs;
+    uint8_t Record[LOC_STORAGE_RECORD_SIZE_MAX];
+#if LOC_STORAGE_CACHE_ENTRIES > 0
+    uint8_t Entry = cache_find(Index);
 
-#if APP_CFG_UC == APP_CFG_UC_STM32
-    NumOfLocs = (uint8_t)(i2c_eeprom_read_byte(I2CAddressAT24C256, EepCfg::locLibEepromAddressNumOfLocs));
-#elif APP_CFG_UC == APP_CFG_UC_ESP8266
-    NumOfLocs       = EEPROM.read(EepCfg::locLibEepromAddressNumOfLocs);
+    if (Entry < LOC_STORAGE_CACHE_ENTRIES)
+    {
+        CacheStats.Hits++;
+    }
+    else
+    {
+        /* The least recently used entry is replaced. */
+        CacheStats.Misses++;
+        Entry = LOC_STORAGE_CACHE_ENTRIES - 1;
+        RecordRead(Record, Index);
+        RecordDecode(Record, &Cache[Entry].Data);
+        Cache[Entry].Slot = Index;
+    }
+
+    cache_use(Entry);
+    memcpy(DataPtr, &Cache[0].Data, sizeof(LocLibData));
+#else
+    RecordRead(Record, Index);
+    RecordDecode(Record, DataPtr);
 #endif
-    return (NumOfLocs);
+
+    return (true);
 }
 
 /***********************************************************************************************************************
  */
-void LocStorage::NumberOfLocsSet(uint8_t numberOfLocs)
+void LocStorage::RecordRead(uint8_t* Record, uint16_t Index)
 {
-#if APP_CFG_UC == APP_CFG_UC_STM32
-    i2c_eeprom_write_byte(I2CAddressAT24C256, EepCfg::locLibEepromAddressNumOfLocs, (byte)(numberOfLocs));
-#elif APP_CFG_UC == APP_CFG_UC_ESP8266
-    EEPROM.write(EepCfg::locLibEepromAddressNumOfLocs, numberOfLocs);
-    EEPROM.commit();
-#endif
+    uint8_t Entry;
+
+    m_Backend.Read(RecordAddress(LOC_STORAGE_LAYOUT_VERSION, Index), Record, LOC_STORAGE_RECORD_SIZE);
+
+    if ((Record[3] & LOC_STORAGE_RECORD_EXT) != 0)
+    {
+        /* Without entry (write interrupted) the functions above F31 are off. */
+        Entry = ext_find(&m_Backend, (uint16_t)(Record[0]) | ((uint16_t)(Record[1]) << 8));
+        if (Entry < LOC_STORAGE_EXT_ENTRIES)
+        {
+            m_Backend.Read(LOC_STORAGE_EXT_ADDRESS + (Entry * LOC_STORAGE_EXT_ENTRY_SIZE) + LOC_STORAGE_EXT_FUNCTIONS,
+                &Record[LOC_STORAGE_RECORD_SIZE], LOC_STORAGE_RECORD_EXT_SIZE);
+        }
+        else
+        {
+            Record[3] &= ~LOC_STORAGE_RECORD_EXT;
+        }
+    }
 }
 
 /***********************************************************************************************************************
  */
-bool LocStorage::LocDataGet(LocLibData* DataPtr, uint8_t Index)
+bool LocStorage::LocDataSet(LocLibData* DataPtr, uint16_t Index)
 {
-    int Address = 0;
+    uint8_t Record[LOC_STORAGE_RECORD_SIZE_MAX];
+    uint8_t Entry;
     bool Result = true;
-#if APP_CFG_UC == APP_CFG_UC_ESP8266
-    LocLibData Data;
-#else
-    uint8_t IndexRead    = 0;
-    uint8_t* DataReadPtr = (uint8_t*)(DataPtr);
-#endif
 
-#if APP_CFG_UC == APP_CFG_UC_ESP8266
-    Address = EepCfg::locLibEepromAddressData + ((sizeof(LocLibData) * Index));
-    EEPROM.get(Address, Data);
-    memcpy(DataPtr, &Data, sizeof(LocLibData));
-#else
-    /* Get address and read data. */
-    Address = EepCfg::locLibEepromAddressLocData + (EepCfg::EepromPageSize * Index);
-    for (IndexRead = 0; IndexRead < sizeof(LocLibData); IndexRead++)
+    RecordEncode(DataPtr, Record);
+
+    /* The functions above F31 are written before the record refers to them and freed after the record no longer
+     * refers to them. */
+    if ((Record[3] & LOC_STORAGE_RECORD_EXT) != 0)
+    {
+        Result = ext_write(&m_Backend, Index, Record);
+        if (Result == false)
+        {
+            Record[3] &= ~LOC_STORAGE_RECORD_EXT;
+        }
+    }
+
+    /* On STM32 the record stride divides the page size, so a record is written in a single page write. */
+    m_Backend.Write(RecordAddress(LOC_STORAGE_LAYOUT_VERSION, Index), Record, LOC_STORAGE_RECORD_SIZE);
+
+    if ((Record[3] & LOC_STORAGE_RECORD_EXT) == 0)
+    {
+        Entry = ext_find(&m_Backend, DataPtr->Addres);
+        if (Entry < LOC_STORAGE_EXT_ENTRIES)
+        {
+            ext_free(&m_Backend, Entry);
+        }
+    }
+    Commit();
+
+#if LOC_STORAGE_CACHE_ENTRIES > 0
+    /* Write through, a cached copy gets the stored data. */
+    Entry = cache_find(Index);
+    if (Entry < LOC_STORAGE_CACHE_ENTRIES)
     {
-        DataReadPtr[IndexRead] = (uint8_t)(i2c_eeprom_read_byte(I2CAddressAT24C256, Address + IndexRead));
+        RecordDecode(Record, &Cache[Entry].Data);
     }
 #endif
 
@@ -264,79 +694,375 @@ bool LocStorage::LocDataGet(LocLibData* DataPtr, uint8_t Index)
 
 /***********************************************************************************************************************
  */
-bool LocStorage::LocDataSet(LocLibData* DataPtr, uint8_t Index)
-{
-    bool Result = true;
-    int Address = 0;
-#if APP_CFG_UC == APP_CFG_UC_STM32
-    uint8_t* DataWritePtr = (uint8_t*)(DataPtr);
-#endif
+void LocStorage::SelectedLocIndexStore(uint16_t Index) { ring_write(&m_Backend, &SelectedLocRing, Index); }
 
-#if APP_CFG_UC == APP_CFG_UC_ESP8266
-    LocLibData Data;
+/***********************************************************************************************************************
+ */
+uint16_t LocStorage::SelectedLocIndexGet()
+{
+    uint16_t Index;
+    uint16_t Value;
 
-    Address = EepCfg::locLibEepromAddressData + ((sizeof(LocLibData) * Index));
-    memcpy(&Data, DataPtr, sizeof(LocLibData));
-    EEPROM.put(Address, Data);
-    EEPROM.commit();
-#else
-    /* Put data of a loc on a single page in the AT24C256. */
-    Address = EepCfg::locLibEepromAddressLocData + (EepCfg::EepromPageSize * Index);
-    i2c_eeprom_write_page(I2CAddressAT24C256, Address, (byte*)(DataWritePtr), sizeof(LocLibData));
-#endif
+    if (ring_read(&m_Backend, &SelectedLocRing, &Value) == true)
+    {
+        Index = Value;
+    }
+    else
+    {
+        /* Nothing stored in ring yet, use index stored by previous versions. */
+        Index = ByteRead(EepCfg::SelectedLocAddress);
+    }
 
-    return (Result);
+    return (Index);
 }
 
 /***********************************************************************************************************************
  */
-void LocStorage::SelectedLocIndexStore(uint8_t Index)
+bool LocStorage::SlotMapGet(uint8_t* Map, uint16_t Length)
 {
-#if APP_CFG_UC == APP_CFG_UC_APP_CFG_UC_ESP8266
-    EEPROM.put(EepCfg::SelectedLocAddress, Index);
-    EEPROM.commit();
-#else
-    i2c_eeprom_write_byte(I2CAddressAT24C256, EepCfg::SelectedLocAddress, Index);
-#endif
+    if (Length > LOC_STORAGE_SLOT_MAP_SIZE)
+    {
+        Length = LOC_STORAGE_SLOT_MAP_SIZE;
+    }
+
+    /* Without valid header the EEPROM was written by a version without slot map. */
+    MapValid = (LayoutGet() == LOC_STORAGE_LAYOUT_VERSION)
+        && (ByteRead(LOC_STORAGE_HEADER_ADDRESS + LOC_STORAGE_HEADER_MAP_VALID) == 1);
+    if (MapValid == true)
+    {
+        m_Backend.Read(LOC_STORAGE_SLOT_MAP_ADDRESS, Map, Length);
+    }
+
+    return (MapValid);
 }
 
 /***********************************************************************************************************************
  */
-uint8_t LocStorage::SelectedLocIndexGet()
+void LocStorage::SlotMapSet(uint8_t* Map, uint16_t Offset, uint16_t Length)
 {
-    uint8_t Index;
+    uint16_t Slot;
+    uint8_t Entry;
 
-#if APP_CFG_UC == APP_CFG_UC_APP_CFG_UC_ESP8266
-    EEPROM.get(EepCfg::SelectedLocAddress, Index);
-#else
-    Index = (uint8_t)(i2c_eeprom_read_byte(I2CAddressAT24C256, EepCfg::SelectedLocAddress));
-#endif
+    if ((Offset + Length) > LOC_STORAGE_SLOT_MAP_SIZE)
+    {
+        Length = LOC_STORAGE_SLOT_MAP_SIZE - Offset;
+    }
 
-    return (Index);
+    /* The functions above F31 of a removed loc are not needed anymore. */
+    ext_find(&m_Backend, LOC_STORAGE_EXT_FREE);
+    for (Entry = 0; Entry < LOC_STORAGE_EXT_ENTRIES; Entry++)
+    {
+        Slot = ExtTable.Slot[Entry];
+        if ((ExtTable.Address[Entry] != LOC_STORAGE_EXT_FREE) && (Slot >= (Offset * 8))
+            && (Slot < ((Offset + Length) * 8)) && ((Map[Slot / 8] & (1 << (Slot % 8))) == 0))
+        {
+            ext_free(&m_Backend, Entry);
+        }
+    }
+
+    m_Backend.Write(LOC_STORAGE_SLOT_MAP_ADDRESS + Offset, &Map[Offset], Length);
+    if (MapValid == false)
+    {
+        HeaderSet(LOC_STORAGE_LAYOUT_VERSION, true);
+    }
+    Commit();
+
+    MapValid = true;
 }
 
 /***********************************************************************************************************************
  */
 void LocStorage::EraseEeprom(void)
 {
-#if APP_CFG_UC == APP_CFG_UC_ESP8266
-    uint16_t Index = 0;
+    uint8_t Erased[32];
+    uint32_t Address;
+    uint16_t Length;
+
+    m_Backend.Erase();
 
-    for (Index = 0; Index < SPI_FLASH_SEC_SIZE; Index++)
+    /* Not every backend erases, so the administration is invalidated explicitly. Without header the slot map is not
+     * used, the ring and the table with the functions above F31 have no valid entries. The records are only read
+     * through the slot map. */
+    memset(Erased, 0xFF, sizeof(Erased));
+    for (Address = LOC_STORAGE_EXT_ADDRESS; Address < LocStorageBackend::Size; Address += Length)
     {
-        EEPROM.write(Index, 0xFF);
+        Length = sizeof(Erased);
+        if ((Address + Length) > LocStorageBackend::Size)
+        {
+            Length = (uint16_t)(LocStorageBackend::Size - Address);
+        }
+        m_Backend.Write((uint16_t)Address, Erased, Length);
     }
-    EEPROM.commit();
-#else
+    Commit();
 
-#endif
+    SelectedLocRing.Scanned = false;
+    MapValid                = false;
+    ExtTable.Scanned        = false;
+    cache_invalidate();
 }
 
-#if APP_CFG_UC == APP_CFG_UC_ESP8266
-void LocStorage::InvalidateAdc(void)
+/***********************************************************************************************************************
+ */
+void LocStorage::TransactionBegin(void) { m_Transaction = true; }
+
+/***********************************************************************************************************************
+ */
+void LocStorage::TransactionEnd(void)
+{
+    m_Transaction = false;
+    m_Backend.Commit();
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorage::WriteBackSet(bool Enable) { m_Backend.WriteBackSet(Enable); }
+
+/***********************************************************************************************************************
+ */
+void LocStorage::Flush(void) { m_Backend.Flush(); }
+
+/***********************************************************************************************************************
+ */
+void LocStorage::Service(void) { m_Backend.Service(); }
+
+/***********************************************************************************************************************
+ */
+void LocStorage::WriteStatsGet(LocStorageWriteStats* Stats) { m_Backend.WriteStatsGet(Stats); }
+
+/***********************************************************************************************************************
+ */
+void LocStorage::WriteStatsReset(void) { m_Backend.WriteStatsReset(); }
+
+/***********************************************************************************************************************
+ */
+void LocStorage::CacheStatsGet(LocStorageCacheStats* Stats)
 {
-    uint8_t buttonAdcValid = 0;
-    EEPROM.write(EepCfg::ButtonAdcValuesAddressValid, buttonAdcValid);
-    EEPROM.commit();
+    memcpy(Stats, &CacheStats, sizeof(LocStorageCacheStats));
 }
+
+/***********************************************************************************************************************
+ */
+void LocStorage::CacheStatsReset(void) { memset(&CacheStats, 0, sizeof(LocStorageCacheStats)); }
+
+#if APP_CFG_UC == APP_CFG_UC_ESP8266
+void LocStorage::InvalidateAdc(void) { ByteWrite(EepCfg::ButtonAdcValuesAddressValid, 0); }
 #endif
+
+/***********************************************************************************************************************
+ */
+uint8_t LocStorage::ByteRead(uint16_t Address)
+{
+    uint8_t Data;
+
+    m_Backend.Read(Address, &Data, 1);
+    return (Data);
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorage::ByteWrite(uint16_t Address, uint8_t Data)
+{
+    m_Backend.Write(Address, &Data, 1);
+    Commit();
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorage::Commit(void)
+{
+    if (m_Transaction == false)
+    {
+        m_Backend.Commit();
+    }
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t LocStorage::LayoutGet(void)
+{
+    uint8_t Layout = ByteRead(LOC_STORAGE_HEADER_ADDRESS + LOC_STORAGE_HEADER_LAYOUT);
+
+    if (Layout == 0xFF)
+    {
+        Layout = LOC_STORAGE_LAYOUT_LEGACY;
+    }
+
+    return (Layout);
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorage::HeaderSet(uint8_t Layout, bool MapWritten)
+{
+    uint8_t Header[LOC_STORAGE_HEADER_USED];
+
+    memset(Header, 0xFF, sizeof(Header));
+    Header[LOC_STORAGE_HEADER_LAYOUT]  = Layout;
+    Header[LOC_STORAGE_HEADER_BUTTONS] = LOC_LIB_FUNCTION_BUTTONS;
+    Header[LOC_STORAGE_HEADER_NAME]    = LOC_LIB_NAME_LENGTH;
+    if (MapWritten == true)
+    {
+        Header[LOC_STORAGE_HEADER_MAP_VALID] = 1;
+    }
+
+    m_Backend.Write(LOC_STORAGE_HEADER_ADDRESS, Header, sizeof(Header));
+}
+
+/***********************************************************************************************************************
+ */
+uint16_t LocStorage::RecordAddress(uint8_t Layout, uint16_t Slot)
+{
+    uint16_t Stride = LocStorageBackend::RecordStride;
+
+    if (Layout != LOC_STORAGE_LAYOUT_PACKED)
+    {
+        Stride = LocStorageBackend::LegacyRecordStride;
+    }
+
+    return (LocStorageBackend::RecordBase + (Stride * Slot));
+}
+
+/***********************************************************************************************************************
+ * Convert the records of an older layout in place to packed records. The slot of a loc is not changed, so the
+ * slot map stays valid. When the packed records are smaller than the raw records the slots are converted from the
+ * first to the last, otherwise from the last to the first, so a converted record never overwrites a raw record
+ * which is not converted yet. The progress is stored in the header, an interrupted migration continues at the
+ * next start. A raw record which overlaps with its own packed record is first copied to the stash in the header.
+ */
+bool LocStorage::LayoutMigrate(void)
+{
+    uint8_t Header[LOC_STORAGE_HEADER_USED];
+    uint8_t Map[LOC_STORAGE_SLOT_MAP_SIZE];
+    uint8_t Record[LOC_STORAGE_RECORD_SIZE_MAX];
+    uint8_t Entries[LOC_STORAGE_EXT_SIZE];
+    LocLibDataLegacy Raw;
+    LocLibData Data;
+    uint8_t Source;
+    uint8_t Count;
+    uint16_t Slots;
+    uint16_t Slot = 0;
+    uint16_t Address;
+    uint16_t Packed;
+    bool Forward = (LocStorageBackend::RecordStride <= LocStorageBackend::LegacyRecordStride);
+    bool Stashed = false;
+    bool Used;
+
+    m_Backend.Read(LOC_STORAGE_HEADER_ADDRESS, Header, sizeof(Header));
+
+    Source = Header[LOC_STORAGE_HEADER_MIGRATION];
+    if (Source == 0xFF)
+    {
+        Source = LayoutGet();
+        if (Source == LOC_STORAGE_LAYOUT_VERSION)
+        {
+            /* Packed records of another name length or number of function buttons can not be read. */
+            return (header_format_match(Header));
+        }
+    }
+    else
+    {
+        /* Continue interrupted migration. */
+        Slot = (uint16_t)(Header[LOC_STORAGE_HEADER_NEXT_SLOT])
+            | ((uint16_t)(Header[LOC_STORAGE_HEADER_NEXT_SLOT + 1]) << 8);
+        Stashed = (Header[LOC_STORAGE_HEADER_STASHED] == 1);
+    }
+
+    if (Source > LOC_STORAGE_LAYOUT_VERSION)
+    {
+        /* Written by a newer version. */
+        return (false);
+    }
+
+    /* Slots of which both the raw and the packed record fit below the table with the functions above F31. */
+    Slots = (LOC_STORAGE_EXT_ADDRESS - LocStorageBackend::RecordBase) / LocStorageBackend::LegacyRecordStride;
+    if (Slots > SlotsMax)
+    {
+        Slots = SlotsMax;
+    }
+
+    /* Occupied slots, the legacy layout stores the locs without free slots in between. */
+    Count = ByteRead(EepCfg::locLibEepromAddressNumOfLocs);
+    if (Source != LOC_STORAGE_LAYOUT_LEGACY)
+    {
+        m_Backend.Read(LOC_STORAGE_SLOT_MAP_ADDRESS, Map, sizeof(Map));
+    }
+
+    if (Header[LOC_STORAGE_HEADER_MIGRATION] == 0xFF)
+    {
+        Slot = (Forward == true) ? 0 : (Slots - 1);
+        MigrationProgressSet(Source, Slot, false);
+    }
+
+    while (Slot < Slots)
+    {
+        if (Source == LOC_STORAGE_LAYOUT_LEGACY)
+        {
+            Used = (Slot < Count);
+        }
+        else
+        {
+            Used = ((Map[Slot / 8] & (1 << (Slot % 8))) != 0);
+        }
+
+        if (Used == true)
+        {
+            /* Raw records were written with the memory layout of LocLibDataLegacy. */
+            Address = RecordAddress(Source, Slot);
+            Packed  = RecordAddress(LOC_STORAGE_LAYOUT_PACKED, Slot);
+            if (Stashed == true)
+            {
+                m_Backend.Read(LOC_STORAGE_HEADER_ADDRESS + LOC_STORAGE_HEADER_STASH, (uint8_t*)(&Raw), sizeof(Raw));
+            }
+            else
+            {
+                m_Backend.Read(Address, (uint8_t*)(&Raw), sizeof(Raw));
+
+                if ((Packed < (Address + sizeof(Raw))) && (Address < (Packed + LOC_STORAGE_RECORD_SIZE)))
+                {
+                    m_Backend.Write(
+                        LOC_STORAGE_HEADER_ADDRESS + LOC_STORAGE_HEADER_STASH, (const uint8_t*)(&Raw), sizeof(Raw));
+                    MigrationProgressSet(Source, Slot, true);
+                }
+            }
+
+            /* Raw records have no functions above F31, so the packed record has no table entry. */
+            legacy_convert(&Raw, &Data);
+            RecordEncode(&Data, Record);
+            m_Backend.Write(Packed, Record, LOC_STORAGE_RECORD_SIZE);
+        }
+
+        /* After the first slot the counter wraps to 0xFFFF when converting backward, ending the loop. */
+        Slot    = (Forward == true) ? (Slot + 1) : (Slot - 1);
+        Stashed = false;
+        if (Used == true)
+        {
+            MigrationProgressSet(Source, Slot, false);
+        }
+    }
+
+    /* Older layouts did not use the table with the functions above F31. */
+    memset(Entries, 0xFF, sizeof(Entries));
+    m_Backend.Write(LOC_STORAGE_EXT_ADDRESS, Entries, sizeof(Entries));
+    ExtTable.Scanned = false;
+
+    /* The legacy layout has no slot map, it is created from the number of locs by LocLib. */
+    HeaderSet(LOC_STORAGE_LAYOUT_VERSION, Source != LOC_STORAGE_LAYOUT_LEGACY);
+    m_Backend.Commit();
+    cache_invalidate();
+
+    return (true);
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorage::MigrationProgressSet(uint8_t Source, uint16_t Slot, bool Stashed)
+{
+    uint8_t Progress[LOC_STORAGE_HEADER_MAP_VALID - LOC_STORAGE_HEADER_MIGRATION];
+
+    Progress[LOC_STORAGE_HEADER_MIGRATION - LOC_STORAGE_HEADER_MIGRATION]     = Source;
+    Progress[LOC_STORAGE_HEADER_NEXT_SLOT - LOC_STORAGE_HEADER_MIGRATION]     = (uint8_t)(Slot & 0xFF);
+    Progress[LOC_STORAGE_HEADER_NEXT_SLOT + 1 - LOC_STORAGE_HEADER_MIGRATION] = (uint8_t)(Slot >> 8);
+    Progress[LOC_STORAGE_HEADER_STASHED - LOC_STORAGE_HEADER_MIGRATION]       = (Stashed == true) ? 1 : 0xFF;
+
+    m_Backend.Write(LOC_STORAGE_HEADER_ADDRESS + LOC_STORAGE_HEADER_MIGRATION, Progress, sizeof(Progress));
+}
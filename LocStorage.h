@@ -8,19 +8,64 @@
 #ifndef LOC_STORAGE_H
 #define LOC_STORAGE_H
 
+#include "LocStorageBackend.h"
 #include "LoclibData.h"
+#include "app_cfg.h"
 #include <Arduino.h>
 
+/* Sizes of the administration data of LocStorage, located at the end of the memory. */
+#define LOC_STORAGE_RING_ENTRIES 64
+#define LOC_STORAGE_RING_ENTRY_SIZE 4
+#define LOC_STORAGE_RING_SIZE (LOC_STORAGE_RING_ENTRIES * LOC_STORAGE_RING_ENTRY_SIZE)
+#define LOC_STORAGE_SLOT_MAP_SIZE 64
+#define LOC_STORAGE_HEADER_SIZE 64
+#ifndef LOC_STORAGE_EXT_ENTRIES
+#define LOC_STORAGE_EXT_ENTRIES 16 /* Locs of which the functions above F31 can be stored. */
+#endif
+#define LOC_STORAGE_EXT_ENTRY_SIZE 10
+#define LOC_STORAGE_EXT_SIZE (LOC_STORAGE_EXT_ENTRIES * LOC_STORAGE_EXT_ENTRY_SIZE)
+#define LOC_STORAGE_ADMIN_SIZE                                                                                         \
+    (LOC_STORAGE_RING_SIZE + LOC_STORAGE_SLOT_MAP_SIZE + LOC_STORAGE_HEADER_SIZE + LOC_STORAGE_EXT_SIZE)
+
+/* Functions above F31, appended to a packed record when at least one of them is on. */
+#define LOC_STORAGE_RECORD_EXT_SIZE (((LOC_LIB_FUNCTIONS + 7) / 8) - 4)
+#define LOC_STORAGE_RECORD_SIZE_MAX (LOC_STORAGE_RECORD_SIZE + LOC_STORAGE_RECORD_EXT_SIZE)
+
+#ifndef LOC_STORAGE_CACHE_ENTRIES
+#define LOC_STORAGE_CACHE_ENTRIES 0 /* Decoded loc records kept in a least recently used cache, 0 disables it. */
+#endif
+
+/**
+ * Lookups in the loc record cache.
+ */
+struct LocStorageCacheStats
+{
+    uint32_t Hits;   /* Loc data read from the cache. */
+    uint32_t Misses; /* Loc data read from EEPROM. */
+};
+
+/* Loc records which fit between the record base and the administration data. */
+#define LOC_STORAGE_RECORDS_FIT                                                                                        \
+    ((LocStorageBackend::Size - LOC_STORAGE_ADMIN_SIZE - LocStorageBackend::RecordBase)                                \
+        / LocStorageBackend::RecordStride)
+
 class LocStorage
 {
 public:
+    /**
+     * Number of loc slots, limited by the size of the memory and the number of bits in the slot map.
+     */
+    static const uint16_t SlotsMax = (LOC_STORAGE_RECORDS_FIT < (LOC_STORAGE_SLOT_MAP_SIZE * 8))
+        ? LOC_STORAGE_RECORDS_FIT
+        : (LOC_STORAGE_SLOT_MAP_SIZE * 8);
+
     /*
      * Init module.
      */
     void Init();
 
     /**
-     * Check EEPROM version.
+     * Check EEPROM version and convert stored locs of an older layout. Returns false when the EEPROM is erased.
      */
     bool VersionCheck();
 
@@ -67,19 +112,157 @@ public:
      */
     void NumberOfLocsSet(uint8_t numberOfLocs);
 
-    bool LocDataGet(LocLibData* DataPtr, uint8_t Index);
-    bool LocDataSet(LocLibData* DataPtr, uint8_t Index);
-    void SelectedLocIndexStore(uint8_t Index);
-    uint8_t SelectedLocIndexGet();
+    bool LocDataGet(LocLibData* DataPtr, uint16_t Index);
+
+    /**
+     * Store loc data. Returns false when the functions above F31 could not be stored because the table for these
+     * functions is full, the rest of the loc data is stored.
+     */
+    bool LocDataSet(LocLibData* DataPtr, uint16_t Index);
+
+    /**
+     * Read the packed record of a loc without converting it, the buffer must hold LOC_STORAGE_RECORD_SIZE_MAX bytes.
+     */
+    void RecordRead(uint8_t* Record, uint16_t Index);
+
+    /**
+     * Convert loc data to a packed record of up to LOC_STORAGE_RECORD_SIZE_MAX bytes, the format in which locs are
+     * stored.
+     */
+    static void RecordEncode(const LocLibData* DataPtr, uint8_t* Record);
+
+    /**
+     * Convert a packed record to loc data.
+     */
+    static void RecordDecode(const uint8_t* Record, LocLibData* DataPtr);
+
+    /**
+     * Get the used size of a packed record, LOC_STORAGE_RECORD_SIZE_MAX when functions above F31 are on, otherwise
+     * LOC_STORAGE_RECORD_SIZE. Only the first LOC_STORAGE_RECORD_SIZE bytes are needed to determine the size.
+     */
+    static uint8_t RecordSize(const uint8_t* Record);
+
+    /**
+     * Store index of selected loc. The index is appended to a wear leveling ring so each store uses another cell.
+     */
+    void SelectedLocIndexStore(uint16_t Index);
+
+    /**
+     * Get index of selected loc, the newest entry in the wear leveling ring.
+     */
+    uint16_t SelectedLocIndexGet();
+
+    /**
+     * Get the occupation bitmap of the loc slots, a set bit is an occupied slot. Returns false when the EEPROM does
+     * not contain a slot map yet.
+     */
+    bool SlotMapGet(uint8_t* Map, uint16_t Length);
+
+    /**
+     * Store the given bytes of the occupation bitmap of the loc slots.
+     */
+    void SlotMapSet(uint8_t* Map, uint16_t Offset, uint16_t Length);
+
+    /**
+     * Erase the memory, at least the header, slot map, ring and table with the functions above F31 are invalidated.
+     */
     void EraseEeprom(void);
+
+    /**
+     * Start a transaction, commits are delayed until TransactionEnd().
+     */
+    void TransactionBegin(void);
+
+    /**
+     * End a transaction and commit its writes. Only the ESP8266 commits all writes of the transaction at once, the
+     * AT24C256 writes each page when it is written (or queued in write back mode).
+     */
+    void TransactionEnd(void);
+
+    /**
+     * Enable or disable write back mode. In write back mode (ESP8266) writes are collected in RAM and committed to
+     * flash by Flush(), after an idle time or when enough bytes are written. In write back mode (STM32) writes are
+     * queued per EEPROM page and written by Service() or Flush(), so a write does not wait for the EEPROM. Reads
+     * return queued data.
+     */
+    void WriteBackSet(bool Enable);
+
+    /**
+     * Commit all pending writes.
+     */
+    void Flush(void);
+
+    /**
+     * Handle delayed storage actions, call cyclic from the main loop.
+     */
+    void Service(void);
+
+    /**
+     * Get the measured duration of EEPROM writes.
+     */
+    void WriteStatsGet(LocStorageWriteStats* Stats);
+
+    /**
+     * Clear the measured duration of EEPROM writes.
+     */
+    void WriteStatsReset(void);
+
+    /**
+     * Get the number of hits and misses of the loc record cache.
+     */
+    void CacheStatsGet(LocStorageCacheStats* Stats);
+
+    /**
+     * Clear the number of hits and misses of the loc record cache.
+     */
+    void CacheStatsReset(void);
 #if APP_CFG_UC == APP_CFG_UC_ESP8266
     void InvalidateAdc();
 #endif
 
 private:
-#if APP_CFG_UC == APP_CFG_UC_STM32
-    uint8_t I2CAddressAT24C256;
-#endif
+    /**
+     * Read a single byte.
+     */
+    uint8_t ByteRead(uint16_t Address);
+
+    /**
+     * Write and commit a single byte.
+     */
+    void ByteWrite(uint16_t Address, uint8_t Data);
+
+    /**
+     * Commit written data, unless a transaction is running.
+     */
+    void Commit(void);
+
+    /**
+     * Get the layout version of the stored data.
+     */
+    uint8_t LayoutGet(void);
+
+    /**
+     * Write the header for the given layout, no migration running.
+     */
+    void HeaderSet(uint8_t Layout, bool MapWritten);
+
+    /**
+     * Get the EEPROM address of the record of a slot in the given layout.
+     */
+    uint16_t RecordAddress(uint8_t Layout, uint16_t Slot);
+
+    /**
+     * Convert stored data of an older layout to the actual layout. Returns false when the layout is unknown.
+     */
+    bool LayoutMigrate(void);
+
+    /**
+     * Store the progress of a running migration.
+     */
+    void MigrationProgressSet(uint8_t Source, uint16_t Slot, bool Stashed);
+
+    LocStorageBackend m_Backend; /* Memory access of the platform. */
+    bool m_Transaction;          /* Commits delayed until end of transaction. */
 };
 
 #endif
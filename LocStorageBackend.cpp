@@ -0,0 +1,683 @@
+/***********************************************************************************************************************
+   @file   LocStorageBackend.cpp
+   @brief  Raw access to the non volatile memory used by LocStorage.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "LocStorageBackend.h"
+#include "app_cfg.h"
+#include <Arduino.h>
+
+/* Built in backends, not built when the application provides its own backend. */
+#ifndef LOC_STORAGE_BACKEND
+
+#if defined(APP_CFG_UC_HOST) && (APP_CFG_UC == APP_CFG_UC_HOST)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif APP_CFG_UC == APP_CFG_UC_ESP8266
+#include <EEPROM.h>
+#else
+#include <Wire.h>
+#endif
+
+/***********************************************************************************************************************
+   D E F I N E S
+ **********************************************************************************************************************/
+#if defined(APP_CFG_UC_HOST) && (APP_CFG_UC == APP_CFG_UC_HOST)
+#elif APP_CFG_UC == APP_CFG_UC_ESP8266
+#define EEPROM_WRITE_BACK_IDLE_TIME 2000 /* Time in ms without writes after which dirty data is committed. */
+#define EEPROM_WRITE_BACK_DIRTY_MAX 512  /* Number of written bytes after which dirty data is committed. */
+#else
+#ifdef BUFFER_LENGTH
+#define I2C_EEPROM_BUFFER_LENGTH BUFFER_LENGTH /* Max bytes per Wire transfer. */
+#else
+#define I2C_EEPROM_BUFFER_LENGTH 32
+#endif
+#define I2C_EEPROM_WRITE_TIMEOUT 20 /* Max time in ms to wait for completion of a write cycle. */
+#ifndef I2C_EEPROM_QUEUE_PAGES
+#define I2C_EEPROM_QUEUE_PAGES 4 /* Page writes queued in write back mode. */
+#endif
+#endif
+
+/***********************************************************************************************************************
+   F O R W A R D  D E C L A R A T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+static LocStorageWriteStats WriteStats; /* Measured duration of EEPROM write cycles / commits. */
+#if defined(APP_CFG_UC_HOST) && (APP_CFG_UC == APP_CFG_UC_HOST)
+const char* LocStorageBackendHost::m_ImageFileName = NULL;
+uint8_t* LocStorageBackendHost::m_Image            = NULL;
+#elif APP_CFG_UC == APP_CFG_UC_ESP8266
+static bool EepromWriteBack;          /* Commit delayed until flush, idle timeout or dirty threshold. */
+static uint16_t EepromDirtyBytes;     /* Bytes written since last commit. */
+static unsigned long EepromDirtyTime; /* Time of last write since last commit. */
+#else
+/**
+ * Write to a page, queued in write back mode.
+ */
+struct EepromQueueEntry
+{
+    uint16_t Page;                                      /* Address of the page. */
+    uint64_t Dirty;                                     /* Bit n set when byte n of the page is written. */
+    uint8_t Data[LocStorageBackendAt24c256::PageSize]; /* Written bytes. */
+};
+
+static_assert(LocStorageBackendAt24c256::PageSize <= 64, "Written bytes of a queued page are kept in 64 bits.");
+
+static bool EepromWriteBack;                                 /* Writes queued until Service() or Flush(). */
+static EepromQueueEntry EepromQueue[I2C_EEPROM_QUEUE_PAGES]; /* Queued page writes, oldest first. */
+static uint8_t EepromQueueCount;                             /* Number of queued page writes. */
+static bool EepromQueueDraining;                             /* Oldest entry partly written. */
+static uint8_t EepromQueueNext;                              /* Next byte of the oldest entry to write. */
+static uint8_t EepromQueueEnd;                               /* End of the bytes of the oldest entry to write. */
+static bool EepromBusy;                                      /* Write cycle started without waiting for it. */
+#endif
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * Update the write statistics with the duration of a write.
+ */
+static void write_stats_update(unsigned long duration, bool completed)
+{
+    WriteStats.Writes++;
+    WriteStats.TimeTotalUs += duration;
+    if (duration > WriteStats.TimeMaxUs)
+    {
+        WriteStats.TimeMaxUs = duration;
+    }
+    if (completed == false)
+    {
+        WriteStats.Timeouts++;
+    }
+}
+
+#if defined(APP_CFG_UC_HOST) && (APP_CFG_UC == APP_CFG_UC_HOST)
+/***********************************************************************************************************************
+ */
+void LocStorageBackendHost::ImageFileSet(const char* FileName) { m_ImageFileName = FileName; }
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendHost::Init(void)
+{
+    int File;
+    struct stat FileStat;
+    uint8_t Erased[PageSize];
+    size_t Length;
+
+    if (m_Image == NULL)
+    {
+        if (m_ImageFileName == NULL)
+        {
+            /* No image file, emulate an empty EEPROM in RAM. */
+            m_Image = (uint8_t*)(mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if (m_Image != MAP_FAILED)
+            {
+                memset(m_Image, 0xFF, Size);
+            }
+        }
+        else
+        {
+            File = open(m_ImageFileName, O_RDWR | O_CREAT, 0644);
+            if (File >= 0)
+            {
+                /* Extend missing part of the image with erased bytes. */
+                memset(Erased, 0xFF, sizeof(Erased));
+                if ((fstat(File, &FileStat) == 0) && (FileStat.st_size < (off_t)(Size)))
+                {
+                    lseek(File, FileStat.st_size, SEEK_SET);
+                    while (FileStat.st_size < (off_t)(Size))
+                    {
+                        Length = sizeof(Erased);
+                        if ((off_t)(Length) > ((off_t)(Size)-FileStat.st_size))
+                        {
+                            Length = (size_t)((off_t)(Size)-FileStat.st_size);
+                        }
+                        if (write(File, Erased, Length) != (ssize_t)(Length))
+                        {
+                            break;
+                        }
+                        FileStat.st_size += Length;
+                    }
+                }
+
+                m_Image = (uint8_t*)(mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, File, 0));
+                close(File);
+            }
+        }
+
+        if (m_Image == MAP_FAILED)
+        {
+            m_Image = NULL;
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendHost::Read(uint16_t Address, uint8_t* Data, uint16_t Length)
+{
+    if ((m_Image != NULL) && ((Address + Length) <= Size))
+    {
+        memcpy(Data, &m_Image[Address], Length);
+    }
+    else
+    {
+        memset(Data, 0xFF, Length);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendHost::Write(uint16_t Address, const uint8_t* Data, uint16_t Length)
+{
+    if ((m_Image != NULL) && ((Address + Length) <= Size))
+    {
+        memcpy(&m_Image[Address], Data, Length);
+        write_stats_update(0, true);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendHost::Commit(void) {}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendHost::Flush(void)
+{
+    if (m_Image != NULL)
+    {
+        msync(m_Image, Size, MS_SYNC);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendHost::Service(void) {}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendHost::Erase(void) {}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendHost::WriteBackSet(bool Enable) { (void)(Enable); }
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendHost::WriteStatsGet(LocStorageWriteStats* Stats)
+{
+    memcpy(Stats, &WriteStats, sizeof(LocStorageWriteStats));
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendHost::WriteStatsReset(void) { memset(&WriteStats, 0, sizeof(LocStorageWriteStats)); }
+
+#elif APP_CFG_UC == APP_CFG_UC_ESP8266
+/***********************************************************************************************************************
+ * Commit the EEPROM data to flash.
+ */
+static void eeprom_flush(void)
+{
+    unsigned long Start;
+    bool Result;
+
+    if (EepromDirtyBytes > 0)
+    {
+        Start  = micros();
+        Result = EEPROM.commit();
+        write_stats_update(micros() - Start, Result);
+
+        EepromDirtyBytes = 0;
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendEsp8266::Init(void) { EEPROM.begin(Size); }
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendEsp8266::Read(uint16_t Address, uint8_t* Data, uint16_t Length)
+{
+    uint16_t Index;
+
+    for (Index = 0; Index < Length; Index++)
+    {
+        Data[Index] = EEPROM.read(Address + Index);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendEsp8266::Write(uint16_t Address, const uint8_t* Data, uint16_t Length)
+{
+    uint16_t Index;
+
+    for (Index = 0; Index < Length; Index++)
+    {
+        EEPROM.write(Address + Index, Data[Index]);
+    }
+
+    EepromDirtyBytes += Length;
+    EepromDirtyTime = millis();
+}
+
+/***********************************************************************************************************************
+ * Commit immediately or in write back mode only when the dirty threshold is reached.
+ */
+void LocStorageBackendEsp8266::Commit(void)
+{
+    if ((EepromWriteBack == false) || (EepromDirtyBytes >= EEPROM_WRITE_BACK_DIRTY_MAX))
+    {
+        eeprom_flush();
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendEsp8266::Flush(void) { eeprom_flush(); }
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendEsp8266::Service(void)
+{
+    /* Commit dirty data when no new writes were done for a while. */
+    if ((EepromDirtyBytes > 0) && ((millis() - EepromDirtyTime) >= EEPROM_WRITE_BACK_IDLE_TIME))
+    {
+        eeprom_flush();
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendEsp8266::Erase(void)
+{
+    uint16_t Index = 0;
+
+    for (Index = 0; Index < Size; Index++)
+    {
+        EEPROM.write(Index, 0xFF);
+    }
+    EepromDirtyBytes += Size;
+    Commit();
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendEsp8266::WriteBackSet(bool Enable)
+{
+    EepromWriteBack = Enable;
+    if (Enable == false)
+    {
+        eeprom_flush();
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendEsp8266::WriteStatsGet(LocStorageWriteStats* Stats)
+{
+    memcpy(Stats, &WriteStats, sizeof(LocStorageWriteStats));
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendEsp8266::WriteStatsReset(void) { memset(&WriteStats, 0, sizeof(LocStorageWriteStats)); }
+
+#else
+/***********************************************************************************************************************
+ * Wait until the EEPROM finished the internal write cycle. During the write cycle the EEPROM does not acknowledge
+ * its address, so poll until the address is acknowledged or the timeout expires.
+ */
+static bool i2c_eeprom_write_wait(int deviceaddress)
+{
+    unsigned long Start = micros();
+    unsigned long Duration;
+    bool Ready = false;
+
+    do
+    {
+        Wire.beginTransmission(deviceaddress);
+        if (Wire.endTransmission() == 0)
+        {
+            Ready = true;
+        }
+        Duration = micros() - Start;
+    } while ((Ready == false) && (Duration < (I2C_EEPROM_WRITE_TIMEOUT * 1000UL)));
+
+    write_stats_update(Duration, Ready);
+
+    return (Ready);
+}
+
+/***********************************************************************************************************************
+ * Wait for the end of a write cycle started by Service(), the EEPROM must be idle before the next access.
+ */
+static void i2c_eeprom_idle(int deviceaddress)
+{
+    if (EepromBusy == true)
+    {
+        i2c_eeprom_write_wait(deviceaddress);
+        EepromBusy = false;
+    }
+}
+
+/***********************************************************************************************************************
+ * Start the write cycle of a chunk within a page, without waiting for its completion. Returns the number of bytes
+ * written, limited by the Wire buffer which also holds the address.
+ */
+static uint16_t i2c_eeprom_write_chunk(int deviceaddress, unsigned int eeaddress, const byte* data, uint16_t length)
+{
+    uint16_t Chunk = length;
+    uint16_t c;
+
+    if (Chunk > (I2C_EEPROM_BUFFER_LENGTH - 2))
+    {
+        Chunk = I2C_EEPROM_BUFFER_LENGTH - 2;
+    }
+
+    Wire.beginTransmission(deviceaddress);
+    Wire.write((int)(eeaddress >> 8));   // MSB
+    Wire.write((int)(eeaddress & 0xFF)); // LSB
+    for (c = 0; c < Chunk; c++)
+        Wire.write(data[c]);
+    Wire.endTransmission();
+
+    return (Chunk);
+}
+
+/***********************************************************************************************************************
+ * Write data within a page. The data is split in chunks which fit in the Wire buffer together with the address.
+ */
+static void i2c_eeprom_write_page(int deviceaddress, unsigned int eeaddresspage, const byte* data, uint16_t length)
+{
+    uint16_t Chunk;
+
+    while (length > 0)
+    {
+        Chunk = i2c_eeprom_write_chunk(deviceaddress, eeaddresspage, data, length);
+        i2c_eeprom_write_wait(deviceaddress);
+
+        eeaddresspage += Chunk;
+        data += Chunk;
+        length -= Chunk;
+    }
+}
+
+/***********************************************************************************************************************
+ * Sequential read, the address is set once and the EEPROM increments its internal address for each read byte.
+ */
+static void i2c_eeprom_read_buffer(int deviceaddress, unsigned int eeaddress, byte* buffer, uint16_t length)
+{
+    uint16_t Chunk;
+    uint16_t Index;
+
+    Wire.beginTransmission(deviceaddress);
+    Wire.write((int)(eeaddress >> 8));   // MSB
+    Wire.write((int)(eeaddress & 0xFF)); // LSB
+    Wire.endTransmission();
+
+    /* Read in chunks which fit in the Wire buffer. */
+    while (length > 0)
+    {
+        Chunk = length;
+        if (Chunk > I2C_EEPROM_BUFFER_LENGTH)
+        {
+            Chunk = I2C_EEPROM_BUFFER_LENGTH;
+        }
+
+        Wire.requestFrom(deviceaddress, (int)(Chunk));
+        for (Index = 0; Index < Chunk; Index++)
+        {
+            buffer[Index] = 0xFF;
+            if (Wire.available()) buffer[Index] = Wire.read();
+        }
+
+        buffer += Chunk;
+        length -= Chunk;
+    }
+}
+
+/***********************************************************************************************************************
+ * Start the next write cycle of the oldest queued page write, optionally waiting for its completion. Only the bytes
+ * from the first to the last written byte are written, unwritten bytes in between are first read from the EEPROM.
+ * The entry is removed from the queue after its last write cycle.
+ */
+static void eeprom_queue_write(int deviceaddress, bool wait)
+{
+    EepromQueueEntry* Entry = &EepromQueue[0];
+    uint8_t Stored[LocStorageBackendAt24c256::PageSize];
+    uint8_t Index;
+    bool Gap = false;
+
+    i2c_eeprom_idle(deviceaddress);
+
+    if (EepromQueueDraining == false)
+    {
+        EepromQueueNext = 0;
+        while ((Entry->Dirty & ((uint64_t)1 << EepromQueueNext)) == 0)
+        {
+            EepromQueueNext++;
+        }
+        EepromQueueEnd = LocStorageBackendAt24c256::PageSize;
+        while ((Entry->Dirty & ((uint64_t)1 << (EepromQueueEnd - 1))) == 0)
+        {
+            EepromQueueEnd--;
+        }
+
+        for (Index = EepromQueueNext; Index < EepromQueueEnd; Index++)
+        {
+            if ((Entry->Dirty & ((uint64_t)1 << Index)) == 0)
+            {
+                Gap = true;
+            }
+        }
+        if (Gap == true)
+        {
+            i2c_eeprom_read_buffer(deviceaddress, Entry->Page + EepromQueueNext, &Stored[EepromQueueNext],
+                EepromQueueEnd - EepromQueueNext);
+            for (Index = EepromQueueNext; Index < EepromQueueEnd; Index++)
+            {
+                if ((Entry->Dirty & ((uint64_t)1 << Index)) == 0)
+                {
+                    Entry->Data[Index] = Stored[Index];
+                    Entry->Dirty |= (uint64_t)1 << Index;
+                }
+            }
+        }
+        EepromQueueDraining = true;
+    }
+
+    EepromQueueNext += i2c_eeprom_write_chunk(
+        deviceaddress, Entry->Page + EepromQueueNext, &Entry->Data[EepromQueueNext], EepromQueueEnd - EepromQueueNext);
+    EepromBusy = true;
+    if (wait == true)
+    {
+        i2c_eeprom_idle(deviceaddress);
+    }
+
+    if (EepromQueueNext >= EepromQueueEnd)
+    {
+        EepromQueueCount--;
+        memmove(&EepromQueue[0], &EepromQueue[1], EepromQueueCount * sizeof(EepromQueueEntry));
+        EepromQueueDraining = false;
+    }
+}
+
+/***********************************************************************************************************************
+ * Add a write within a page to the queue. A write directly following a write to the same page is merged with it,
+ * otherwise the write gets its own entry so the writes reach the EEPROM in the order they were done. When the queue
+ * is full the oldest entry is written first.
+ */
+static void eeprom_queue_add(int deviceaddress, uint16_t address, const uint8_t* data, uint16_t length)
+{
+    EepromQueueEntry* Entry = NULL;
+    uint16_t Page           = address - (address % LocStorageBackendAt24c256::PageSize);
+    uint8_t Offset          = (uint8_t)(address - Page);
+    uint64_t Bits           = (length >= 64) ? ~(uint64_t)0 : (((uint64_t)1 << length) - 1);
+
+    /* The oldest entry can not be extended once its write cycles started. */
+    if ((EepromQueueCount > 0) && (EepromQueue[EepromQueueCount - 1].Page == Page)
+        && ((EepromQueueCount > 1) || (EepromQueueDraining == false)))
+    {
+        Entry = &EepromQueue[EepromQueueCount - 1];
+    }
+    else
+    {
+        while (EepromQueueCount == I2C_EEPROM_QUEUE_PAGES)
+        {
+            eeprom_queue_write(deviceaddress, true);
+        }
+
+        Entry        = &EepromQueue[EepromQueueCount++];
+        Entry->Page  = Page;
+        Entry->Dirty = 0;
+    }
+
+    memcpy(&Entry->Data[Offset], data, length);
+    Entry->Dirty |= Bits << Offset;
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendAt24c256::Init(void)
+{
+    I2CAddressAT24C256 = 0x50;
+    Wire.begin();
+}
+
+/***********************************************************************************************************************
+ * Queued data not yet in the EEPROM is read from the queue.
+ */
+void LocStorageBackendAt24c256::Read(uint16_t Address, uint8_t* Data, uint16_t Length)
+{
+    EepromQueueEntry* Entry;
+    uint8_t Queued;
+    uint16_t Index;
+    uint16_t Byte;
+
+    i2c_eeprom_idle(I2CAddressAT24C256);
+    i2c_eeprom_read_buffer(I2CAddressAT24C256, Address, Data, Length);
+
+    for (Queued = 0; Queued < EepromQueueCount; Queued++)
+    {
+        Entry = &EepromQueue[Queued];
+        if ((Entry->Page < (Address + Length)) && (Address < (Entry->Page + PageSize)))
+        {
+            for (Index = 0; Index < PageSize; Index++)
+            {
+                Byte = Entry->Page + Index;
+                if (((Entry->Dirty & ((uint64_t)1 << Index)) != 0) && (Byte >= Address) && (Byte < (Address + Length)))
+                {
+                    Data[Byte - Address] = Entry->Data[Index];
+                }
+            }
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendAt24c256::Write(uint16_t Address, const uint8_t* Data, uint16_t Length)
+{
+    uint16_t Chunk;
+
+    /* A write may not cross a page boundary, the address would roll over to the begin of the page. */
+    while (Length > 0)
+    {
+        Chunk = PageSize - (Address % PageSize);
+        if (Chunk > Length)
+        {
+            Chunk = Length;
+        }
+
+        if (EepromWriteBack == true)
+        {
+            eeprom_queue_add(I2CAddressAT24C256, Address, Data, Chunk);
+        }
+        else
+        {
+            i2c_eeprom_idle(I2CAddressAT24C256);
+            i2c_eeprom_write_page(I2CAddressAT24C256, Address, Data, Chunk);
+        }
+
+        Address += Chunk;
+        Data += Chunk;
+        Length -= Chunk;
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendAt24c256::Commit(void) {}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendAt24c256::Flush(void)
+{
+    while (EepromQueueCount > 0)
+    {
+        eeprom_queue_write(I2CAddressAT24C256, true);
+    }
+    i2c_eeprom_idle(I2CAddressAT24C256);
+}
+
+/***********************************************************************************************************************
+ * Start at most one write cycle of the queue, without waiting. When the previous write cycle is not completed yet
+ * nothing is done.
+ */
+void LocStorageBackendAt24c256::Service(void)
+{
+    if (EepromBusy == true)
+    {
+        Wire.beginTransmission(I2CAddressAT24C256);
+        EepromBusy = (Wire.endTransmission() != 0);
+    }
+
+    if ((EepromBusy == false) && (EepromQueueCount > 0))
+    {
+        eeprom_queue_write(I2CAddressAT24C256, false);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendAt24c256::Erase(void) {}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendAt24c256::WriteBackSet(bool Enable)
+{
+    if (Enable == false)
+    {
+        Flush();
+    }
+    EepromWriteBack = Enable;
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendAt24c256::WriteStatsGet(LocStorageWriteStats* Stats)
+{
+    memcpy(Stats, &WriteStats, sizeof(LocStorageWriteStats));
+}
+
+/***********************************************************************************************************************
+ */
+void LocStorageBackendAt24c256::WriteStatsReset(void) { memset(&WriteStats, 0, sizeof(LocStorageWriteStats)); }
+#endif
+
+#endif
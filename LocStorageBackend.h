@@ -0,0 +1,182 @@
+/**
+ **********************************************************************************************************************
+ * @file  LocStorageBackend.h
+ * @brief Raw access to the non volatile memory used by LocStorage.
+ ***********************************************************************************************************************
+ */
+
+#ifndef LOC_STORAGE_BACKEND_H
+#define LOC_STORAGE_BACKEND_H
+
+#include "LoclibData.h"
+#include "app_cfg.h"
+#include "eep_cfg.h"
+#include <Arduino.h>
+
+#if defined(LOC_STORAGE_BACKEND)
+#elif defined(APP_CFG_UC_HOST) && (APP_CFG_UC == APP_CFG_UC_HOST)
+#elif APP_CFG_UC == APP_CFG_UC_ESP8266
+#include <spi_flash.h>
+#endif
+
+/**
+ * Measured duration of EEPROM writes (STM32 write cycles, ESP8266 flash commits).
+ */
+struct LocStorageWriteStats
+{
+    uint32_t Writes;      /* Number of write cycles / commits. */
+    uint32_t TimeTotalUs; /* Total time spent waiting for write completion. */
+    uint32_t TimeMaxUs;   /* Longest write. */
+    uint32_t Timeouts;    /* Writes not completed within timeout. */
+};
+
+/* Size of a packed loc record: address, speed, flags, F0 up to F31, function assignment and name. */
+#define LOC_STORAGE_RECORD_SIZE (8 + LOC_LIB_FUNCTION_BUTTONS + LOC_LIB_NAME_LENGTH)
+
+/*
+ * Each backend provides the same interface, LocStorage uses the backend selected by APP_CFG_UC:
+ *
+ *   Size, PageSize            Size of the memory and size of a write page in bytes.
+ *   RecordBase, RecordStride  Address of the first loc record and distance between loc records.
+ *   LegacyRecordStride        Distance between raw LocLibDataLegacy records of previous versions.
+ *   Init()                    Start access to the memory.
+ *   Read(Address, Data, Len)  Read any number of bytes.
+ *   Write(Address, Data, Len) Write any number of bytes, page boundaries are handled by the backend.
+ *   Commit()                  End of a write action, written data must become persistent (unless write back).
+ *   Flush()                   Make all written data persistent.
+ *   Service()                 Delayed actions, called cyclic from the main loop.
+ *   Erase()                   Erase the application area of the memory.
+ *   WriteBackSet(Enable)      Delay writes or commits to coalesce them, if supported. Reads return delayed data.
+ *   WriteStatsGet / Reset     Measured duration of writes.
+ *
+ * The constants must be compile time constants and the methods are not virtual, so each target is built for exactly
+ * one backend and the calls of LocStorage bind directly to it. Addresses are 16 bit, so Size is at most 64 KB.
+ *
+ * An application provides its own backend (FRAM, SPI flash, ...) by defining LOC_STORAGE_BACKEND as the name of a
+ * class with this interface and LOC_STORAGE_BACKEND_HEADER as the header declaring it, for example
+ * -DLOC_STORAGE_BACKEND=FramBackend -DLOC_STORAGE_BACKEND_HEADER='"FramBackend.h"'. The backends below are then not
+ * built and LocStorage / LocLib are used unchanged.
+ */
+
+#if defined(LOC_STORAGE_BACKEND)
+
+#include LOC_STORAGE_BACKEND_HEADER
+
+typedef LOC_STORAGE_BACKEND LocStorageBackend;
+
+#elif defined(APP_CFG_UC_HOST) && (APP_CFG_UC == APP_CFG_UC_HOST)
+
+#ifndef LOCLIB_HOST_EEPROM_SIZE
+#define LOCLIB_HOST_EEPROM_SIZE 32768 /* Same size as AT24C256, so EEPROM dumps of STM32 devices can be used. */
+#endif
+#ifndef LOCLIB_HOST_RECORD_STRIDE
+#define LOCLIB_HOST_RECORD_STRIDE 0 /* Distance between loc records, 0 for the distance used on AT24C256. */
+#endif
+
+/**
+ * Host (Linux) backend, the EEPROM is a memory mapped image file or when no file is given a RAM buffer.
+ */
+class LocStorageBackendHost
+{
+public:
+    static const uint32_t Size               = LOCLIB_HOST_EEPROM_SIZE;
+    static const uint16_t PageSize           = EepCfg::EepromPageSize;
+    static const uint16_t RecordBase         = EepCfg::locLibEepromAddressLocData;
+#if LOCLIB_HOST_RECORD_STRIDE != 0
+    static const uint16_t RecordStride       = LOCLIB_HOST_RECORD_STRIDE;
+#else
+    static const uint16_t RecordStride       = (LOC_STORAGE_RECORD_SIZE <= (EepCfg::EepromPageSize / 2))
+        ? (EepCfg::EepromPageSize / 2)
+        : EepCfg::EepromPageSize; /* Two records per page when they fit, a record never crosses a page. */
+#endif
+    static const uint16_t LegacyRecordStride = EepCfg::EepromPageSize;
+
+    /**
+     * Set the image file used by the next Init(). Missing or too small files are created / extended with 0xFF.
+     */
+    static void ImageFileSet(const char* FileName);
+
+    void Init(void);
+    void Read(uint16_t Address, uint8_t* Data, uint16_t Length);
+    void Write(uint16_t Address, const uint8_t* Data, uint16_t Length);
+    void Commit(void);
+    void Flush(void);
+    void Service(void);
+    void Erase(void);
+    void WriteBackSet(bool Enable);
+    void WriteStatsGet(LocStorageWriteStats* Stats);
+    void WriteStatsReset(void);
+
+private:
+    static const char* m_ImageFileName; /* Image file for next Init(). */
+    static uint8_t* m_Image;            /* Mapped image, shared by all copies of the backend. */
+};
+
+typedef LocStorageBackendHost LocStorageBackend;
+
+#elif APP_CFG_UC == APP_CFG_UC_ESP8266
+
+/**
+ * ESP8266 backend, EEPROM emulated in flash with a RAM mirror. The core limits the emulated EEPROM to one flash
+ * sector, EEPROM.begin() with a larger size gives one sector and access above it is ignored.
+ */
+class LocStorageBackendEsp8266
+{
+public:
+    static const uint32_t Size               = SPI_FLASH_SEC_SIZE;
+    static const uint16_t PageSize           = SPI_FLASH_SEC_SIZE;
+    static const uint16_t RecordBase         = EepCfg::locLibEepromAddressData;
+    static const uint16_t RecordStride       = (LOC_STORAGE_RECORD_SIZE <= 24) ? 24 : LOC_STORAGE_RECORD_SIZE;
+    static const uint16_t LegacyRecordStride = sizeof(LocLibDataLegacy);
+
+    void Init(void);
+    void Read(uint16_t Address, uint8_t* Data, uint16_t Length);
+    void Write(uint16_t Address, const uint8_t* Data, uint16_t Length);
+    void Commit(void);
+    void Flush(void);
+    void Service(void);
+    void Erase(void);
+    void WriteBackSet(bool Enable);
+    void WriteStatsGet(LocStorageWriteStats* Stats);
+    void WriteStatsReset(void);
+};
+
+typedef LocStorageBackendEsp8266 LocStorageBackend;
+
+#else
+
+/**
+ * STM32 backend, AT24C256 I2C EEPROM. In write back mode writes are queued per page in RAM, Service() starts the
+ * write cycles one at a time without waiting for them.
+ */
+class LocStorageBackendAt24c256
+{
+public:
+    static const uint32_t Size               = 32768;
+    static const uint16_t PageSize           = EepCfg::EepromPageSize;
+    static const uint16_t RecordBase         = EepCfg::locLibEepromAddressLocData;
+    static const uint16_t RecordStride       = (LOC_STORAGE_RECORD_SIZE <= (EepCfg::EepromPageSize / 2))
+        ? (EepCfg::EepromPageSize / 2)
+        : EepCfg::EepromPageSize; /* Two records per page when they fit, a record never crosses a page. */
+    static const uint16_t LegacyRecordStride = EepCfg::EepromPageSize;
+
+    void Init(void);
+    void Read(uint16_t Address, uint8_t* Data, uint16_t Length);
+    void Write(uint16_t Address, const uint8_t* Data, uint16_t Length);
+    void Commit(void);
+    void Flush(void);
+    void Service(void);
+    void Erase(void);
+    void WriteBackSet(bool Enable);
+    void WriteStatsGet(LocStorageWriteStats* Stats);
+    void WriteStatsReset(void);
+
+private:
+    uint8_t I2CAddressAT24C256;
+};
+
+typedef LocStorageBackendAt24c256 LocStorageBackend;
+
+#endif
+
+#endif
@@ -5,31 +5,225 @@
 #include "app_cfg.h"
 #include "eep_cfg.h"
 #include <Arduino.h>
-#include <EEPROM.h>
 #include <Loclib.h>
 #include <string.h>
 
+/* Image of Export() / Import(), multi byte values little endian:
+ *  0  Magic "LLDB" (4)
+ *  4  Image version (1)
+ *  5  Record size (1)
+ *  6  AC option (1)
+ *  7  Emergency option (1)
+ *  8  Number of locs (2)
+ * 10  Name length, LOC_LIB_NAME_LENGTH (1), image version 3
+ * 11  Function buttons, LOC_LIB_FUNCTION_BUTTONS (1), image version 3
+ * 12  Packed loc records in list order, see LocStorage::RecordEncode(). A record has the record size, plus the
+ *     functions above F31 when its flags indicate these are present (image version 2 and up). Versions 1 and 2 have
+ *     no name length and buttons, their records start at 10 and hold 10 characters and 5 buttons.
+ *  n  CRC-32 (IEEE 802.3) of all preceding bytes (4) */
+#define LOCLIB_IMAGE_MAGIC "LLDB"
+#define LOCLIB_IMAGE_VERSION 3
+#define LOCLIB_IMAGE_VERSION_EXT 2  /* Image without record format, still accepted by Import(). */
+#define LOCLIB_IMAGE_VERSION_BASE 1 /* Image without functions above F31, still accepted by Import(). */
+#define LOCLIB_IMAGE_HEADER_SIZE 12
+#define LOCLIB_IMAGE_HEADER_SIZE_BASE 10 /* Header of image versions 1 and 2. */
+#define LOCLIB_IMAGE_NAME_LENGTH_BASE 10 /* Name length of image versions 1 and 2. */
+#define LOCLIB_IMAGE_BUTTONS_BASE 5      /* Function buttons of image versions 1 and 2. */
+#define LOCLIB_IMAGE_CRC_SIZE 4
+
+static_assert(LocLib::MaxNumberOfLocs <= LocStorage::SlotsMax, "More locs configured than fit in the EEPROM.");
+
+/* Highest speed step for each decoderSteps value. */
+static const uint8_t SpeedStepsMax[3] = { 14, 28, 127 };
+
+/* Highest loc address sent as short address, as done by XpressNet command stations. */
+#define LOCLIB_SHORT_ADDRESS_MAX 99
+
+/* Speed step to speed bits of the instruction, 0 is stop and 1 emergency stop. The 14 step code is step + 1, the 28
+ * step code is step + 3 with its LSB moved to bit 4. 128 steps uses step + 1 without table. */
+static const uint8_t SpeedCode14[15] = { 0x00, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D,
+    0x0E, 0x0F };
+static const uint8_t SpeedCode28[29] = { 0x00, 0x02, 0x12, 0x03, 0x13, 0x04, 0x14, 0x05, 0x15, 0x06, 0x16, 0x07, 0x17,
+    0x08, 0x18, 0x09, 0x19, 0x0A, 0x1A, 0x0B, 0x1B, 0x0C, 0x1C, 0x0D, 0x1D, 0x0E, 0x1E, 0x0F, 0x1F };
+
+/* XpressNet identification of the speed instruction for each decoderSteps value. */
+static const uint8_t SpeedXpNetId[3] = { 0x10, 0x12, 0x13 };
+
+/**
+ * Encoding of a function group.
+ */
+struct FunctionGroupCode
+{
+    uint8_t First;          /* Number of the first function in the group bits, F0 of group 1 is added to bit 4. */
+    uint8_t Mask;           /* Bits of the group. */
+    uint8_t XpNetId;        /* XpressNet identification. */
+    uint8_t DccInstruction; /* DCC instruction, the bits are added or for 8 bit groups sent in the next byte. */
+};
+
+/* The groups above F28 use the XpressNet identifications of the Z21 LAN protocol and the DCC feature expansion
+ * instructions of RCN-212. */
+static const FunctionGroupCode FunctionGroups[10] = { { 1, 0x0F, 0x20, 0x80 }, { 5, 0x0F, 0x21, 0xB0 },
+    { 9, 0x0F, 0x22, 0xA0 }, { 13, 0xFF, 0x23, 0xDE }, { 21, 0xFF, 0x28, 0xDF }, { 29, 0xFF, 0x29, 0xD8 },
+    { 37, 0xFF, 0x2A, 0xD9 }, { 45, 0xFF, 0x2B, 0xDA }, { 53, 0xFF, 0x50, 0xDB }, { 61, 0xFF, 0x51, 0xDC } };
+
+/* Number of bits set in a nibble. */
+static const uint8_t SlotMapNibbleCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+/***********************************************************************************************************************
+ * Number of occupied slots in a byte of the slot map.
+ */
+static uint8_t slot_map_count(uint8_t Byte)
+{
+    return (SlotMapNibbleCount[Byte & 0x0F] + SlotMapNibbleCount[Byte >> 4]);
+}
+
+/* CRC-32 of a nibble, reflected polynomial 0xEDB88320. */
+static const uint32_t ImageCrcTable[16] = { 0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+    0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278,
+    0xBDBDF21C };
+
+/***********************************************************************************************************************
+ * Update the CRC of an image with the given bytes.
+ */
+static uint32_t image_crc(uint32_t Crc, const uint8_t* Data, uint16_t Length)
+{
+    uint16_t Index;
+
+    for (Index = 0; Index < Length; Index++)
+    {
+        Crc ^= Data[Index];
+        Crc = (Crc >> 4) ^ ImageCrcTable[Crc & 0x0F];
+        Crc = (Crc >> 4) ^ ImageCrcTable[Crc & 0x0F];
+    }
+
+    return (Crc);
+}
+
+/***********************************************************************************************************************
+ * Pass bytes of an image to the sink of an export.
+ */
+static bool image_write(LocLib::ExportSink Sink, void* Context, const uint8_t* Data, uint16_t Length, uint32_t* Crc)
+{
+    *Crc = image_crc(*Crc, Data, Length);
+
+    return (Sink(Data, Length, Context));
+}
+
+/***********************************************************************************************************************
+ * Get bytes of an image from the source of an import.
+ */
+static bool image_read(LocLib::ImportSource Source, void* Context, uint8_t* Data, uint16_t Length, uint32_t* Crc)
+{
+    bool Result = (Source(Data, Length, Context) == Length);
+
+    *Crc = image_crc(*Crc, Data, Length);
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ * Write the address of an instruction, XpressNet always uses two bytes. Returns the number of bytes written.
+ */
+static uint8_t instruction_address(LocLib::protocol Protocol, uint16_t Address, uint8_t* Data)
+{
+    uint8_t Length = 2;
+
+    if (Address > LOCLIB_SHORT_ADDRESS_MAX)
+    {
+        Data[0] = 0xC0 | (uint8_t)(Address >> 8);
+        Data[1] = (uint8_t)(Address & 0xFF);
+    }
+    else if (Protocol == LocLib::protocolXpressNet)
+    {
+        Data[0] = 0x00;
+        Data[1] = (uint8_t)(Address);
+    }
+    else
+    {
+        Data[0] = (uint8_t)(Address);
+        Length  = 1;
+    }
+
+    return (Length);
+}
+
+/***********************************************************************************************************************
+ * Append the XOR of all bytes, the XpressNet check byte or the DCC error byte. Returns the total length.
+ */
+static uint8_t instruction_check(uint8_t* Data, uint8_t Length)
+{
+    uint8_t Index;
+    uint8_t Check = 0;
+
+    for (Index = 0; Index < Length; Index++)
+    {
+        Check ^= Data[Index];
+    }
+    Data[Length] = Check;
+
+    return (Length + 1);
+}
+
+/***********************************************************************************************************************
+ * Get the change bits of the function groups containing changed functions.
+ */
+static uint16_t function_changes(const LocLibFunctions* Old, const LocLibFunctions* New)
+{
+    uint8_t Group;
+    uint8_t First;
+    uint16_t Changes = 0;
+
+    for (Group = 0; Group < (sizeof(FunctionGroups) / sizeof(FunctionGroups[0])); Group++)
+    {
+        First = FunctionGroups[Group].First;
+        if (((Old->Group(First) ^ New->Group(First)) & FunctionGroups[Group].Mask) != 0)
+        {
+            Changes |= (uint16_t)(LocLib::changeFunctionGroup1 << Group);
+        }
+    }
+
+    /* F0 is part of group 1. */
+    if (Old->Get(0) != New->Get(0))
+    {
+        Changes |= LocLib::changeFunctionGroup1;
+    }
+
+    return (Changes);
+}
+
 /***********************************************************************************************************************
  */
 LocLib::LocLib()
 {
-    m_AcOption          = 0;
-    m_NumberOfLocs      = 1;
-    m_ActualSelectedLoc = 0;
-    memset(&m_LocLibData, 0, sizeof(LocLibData));
+    m_AcOption           = 0;
+    m_NumberOfLocs       = 1;
+    m_ActualSelectedLoc  = 0;
+    m_NumberOfActiveLocs = 1;
+    m_ActiveLoc          = 0;
+    m_LocLibData         = &m_ActiveLocs[0];
+    m_SortedInsert       = (LOCLIB_SORTED_INSERT == 1);
+    memset(m_ActiveLocs, 0, sizeof(m_ActiveLocs));
+    memset(m_ActiveSlots, 0, sizeof(m_ActiveSlots));
+    memset(m_ActiveRamps, 0, sizeof(m_ActiveRamps));
+    memset(m_ActiveChanges, 0, sizeof(m_ActiveChanges));
+    memset(&m_LocLibDataRead, 0, sizeof(LocLibData));
+    memset(m_LocIndex, 0, sizeof(m_LocIndex));
+    memset(m_SlotMap, 0, sizeof(m_SlotMap));
 }
 
 /***********************************************************************************************************************
  */
 void LocLib::Init(LocStorage Storage)
 {
+    uint16_t Slot;
+
     m_LocStorage = Storage;
 
     if (m_LocStorage.VersionCheck() == false)
     {
         InitialLocStore();
         m_LocStorage.NumberOfLocsSet(m_NumberOfLocs);
-        StoreLoc(m_LocLibData.Addres, m_LocLibData.FunctionAssignment, NULL, storeAdd);
+        StoreLoc(m_LocLibData->Addres, m_LocLibData->FunctionAssignment, NULL, storeAdd);
 
         m_LocStorage.AcOptionSet(0);
         m_LocStorage.EmergencyOptionSet(0);
@@ -38,59 +232,111 @@ void LocLib::Init(LocStorage Storage)
     /* Check AC option.*/
     m_AcOption = m_LocStorage.AcOptionGet();
 
-    /* Read data from EEPROM of first loc. */
-    m_ActualSelectedLoc = m_LocStorage.SelectedLocIndexGet();
-    if (m_ActualSelectedLoc > MaxNumberOfLocs)
+    /* Get the occupied slots. Previous versions stored the locs without free slots in between. */
+    if (m_LocStorage.SlotMapGet(m_SlotMap, sizeof(m_SlotMap)) == false)
+    {
+        m_NumberOfLocs = m_LocStorage.NumberOfLocsGet();
+        if (m_NumberOfLocs > MaxNumberOfLocs)
+        {
+            m_NumberOfLocs = 1;
+        }
+
+        memset(m_SlotMap, 0, sizeof(m_SlotMap));
+        for (Slot = 0; Slot < m_NumberOfLocs; Slot++)
+        {
+            m_SlotMap[Slot / 8] |= (1 << (Slot % 8));
+        }
+        m_LocStorage.SlotMapSet(m_SlotMap, 0, sizeof(m_SlotMap));
+    }
+
+    ResidentLoad();
+    LocIndexBuild();
+
+    if (m_NumberOfLocs == 0)
+    {
+        InitialLocStore();
+    }
+
+    /* Read data from EEPROM of selected loc. */
+    Slot = m_LocStorage.SelectedLocIndexGet();
+    if ((Slot >= MaxNumberOfLocs) || (SlotUsed(Slot) == false))
     {
-        m_ActualSelectedLoc = 0;
+        Slot = SlotByPosition(0);
     }
-    m_LocStorage.LocDataGet(&m_LocLibData, m_ActualSelectedLoc);
-    m_NumberOfLocs = m_LocStorage.NumberOfLocsGet();
 
-    /* Get number of locs and check it... */
-    if (m_NumberOfLocs > MaxNumberOfLocs)
+    /* The selected loc is the only active loc. */
+    m_NumberOfActiveLocs = 1;
+    m_ActiveSlots[0]     = Slot;
+    ActiveLocSelectSet(0);
+    LocDataRead(m_LocLibData, Slot);
+    ActiveLocStart(0);
+
+    /* Locs stored without sorted insertion. */
+    if (m_SortedInsert == true)
     {
-        m_LocStorage.NumberOfLocsSet(1);
-        m_NumberOfLocs = 1;
+        LocSortedRestore();
     }
 }
 
 /***********************************************************************************************************************
  */
-LocLibData* LocLib::DataGet(void) { return (&m_LocLibData); }
+LocLibData* LocLib::DataGet(void) { return (m_LocLibData); }
 
 /***********************************************************************************************************************
  */
 void LocLib::UpdateLocData(uint16_t address)
 {
-    uint16_t Index = 0;
-    bool Found     = false;
-    LocLibData Data;
+    uint16_t Index = CheckLoc(address);
 
-    while ((Index < m_NumberOfLocs) && (Found == false))
+    if (Index != LocNotFound)
     {
-        // Read data from EEPROM and check address.
-        m_LocStorage.LocDataGet(&Data, Index);
+        ActiveLocLoad(Index);
+    }
+}
 
-        if (Data.Addres == address)
-        {
-            Found = true;
-            memcpy(&m_LocLibData, &Data, sizeof(LocLibData));
-        }
-        else
+/***********************************************************************************************************************
+ */
+uint16_t LocLib::SpeedSet(int8_t Delta) { return (SpeedSet(Delta, 1)); }
+
+/***********************************************************************************************************************
+ */
+uint16_t LocLib::SpeedSet(int8_t Delta, uint8_t Steps)
+{
+    uint16_t Speed  = 0xFFFF;
+    uint16_t Actual = m_LocLibData->Speed;
+    uint8_t Step;
+
+    if (Delta == 0)
+    {
+        /* A stop is never repeated, a second stop would change the direction. */
+        Steps = 1;
+    }
+
+    for (Step = 0; Step < Steps; Step++)
+    {
+        /* Each step continues from the speed of the previous step as if it was sent and updated. */
+        Speed = SpeedStep(Delta, Actual);
+        if (Speed != 0xFFFF)
         {
-            Index++;
+            Actual = Speed;
         }
     }
+
+    return (Speed);
 }
 
 /***********************************************************************************************************************
  */
-uint16_t LocLib::SpeedSet(int8_t Delta)
+uint16_t LocLib::SpeedStep(int8_t Delta, uint16_t Actual)
 {
     uint16_t Speed = 0xFFFF;
 
-    if (m_AcOption == false)
+    if ((m_ActiveRamps[m_ActiveLoc].Acceleration != 0) || (m_ActiveRamps[m_ActiveLoc].Deceleration != 0))
+    {
+        /* Momentum, the target speed is changed and Tick() ramps the speed. */
+        Speed = SpeedTargetSet(Delta);
+    }
+    else if (m_AcOption == false)
     {
         if (Delta == 0)
         {
@@ -101,22 +347,22 @@ uint16_t LocLib::SpeedSet(int8_t Delta)
         {
             /* Handle direction change or increase / decrease speed depending on
              * direction. */
-            if ((m_LocLibData.Speed == 0) && (m_LocLibData.Dir == directionBackWard))
+            if ((Actual == 0) && (m_LocLibData->Dir == directionBackWard))
             {
-                m_LocLibData.Dir = directionForward;
-                Speed            = m_LocLibData.Speed;
+                DirectionSet(directionForward);
+                Speed = Actual;
             }
             else
             {
-                if (m_LocLibData.Dir == directionForward)
+                if (m_LocLibData->Dir == directionForward)
                 {
                     /* Handle speed increase*/
-                    Speed = SpeedIncrease();
+                    Speed = SpeedIncrease(Actual);
                 }
                 else
                 {
                     /* Handle speed decrease*/
-                    Speed = SpeedDecrease();
+                    Speed = SpeedDecrease(Actual);
                 }
             }
         }
@@ -124,23 +370,23 @@ uint16_t LocLib::SpeedSet(int8_t Delta)
         {
             /* Handle direction change or increase / decrease speed depending on
              * direction. */
-            if ((m_LocLibData.Speed == 0) && (m_LocLibData.Dir == directionForward))
+            if ((Actual == 0) && (m_LocLibData->Dir == directionForward))
             {
-                m_LocLibData.Dir = directionBackWard;
-                Speed            = m_LocLibData.Speed;
+                DirectionSet(directionBackWard);
+                Speed = Actual;
             }
             else
             {
-                if (m_LocLibData.Dir == directionForward)
+                if (m_LocLibData->Dir == directionForward)
                 {
                     /* Handle speed decrease*/
-                    Speed = SpeedDecrease();
+                    Speed = SpeedDecrease(Actual);
                 }
                 else
                 {
 
                     /* Handle speed increase*/
-                    Speed = SpeedIncrease();
+                    Speed = SpeedIncrease(Actual);
                 }
             }
         }
@@ -151,12 +397,12 @@ uint16_t LocLib::SpeedSet(int8_t Delta)
         if (Delta > 0)
         {
             /* Handle speed increase*/
-            Speed = SpeedIncrease();
+            Speed = SpeedIncrease(Actual);
         }
         else if (Delta < 0)
         {
             /* Handle speed decrease*/
-            Speed = SpeedDecrease();
+            Speed = SpeedDecrease(Actual);
         }
         else
         {
@@ -166,79 +412,203 @@ uint16_t LocLib::SpeedSet(int8_t Delta)
     }
 
     /* Limit speed based on decoder type. */
-    if (Speed != 0xFFFF)
+    if ((Speed != 0xFFFF) && (Speed > SpeedStepsMax[m_LocLibData->Steps]))
+    {
+        Speed = SpeedStepsMax[m_LocLibData->Steps];
+    }
+
+    return (Speed);
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t LocLib::SpeedGet(void) { return (m_LocLibData->Speed); }
+
+/***********************************************************************************************************************
+ */
+void LocLib::SpeedUpdate(uint8_t Speed)
+{
+    if (m_LocLibData->Speed != Speed)
+    {
+        m_LocLibData->Speed = Speed;
+        m_ActiveChanges[m_ActiveLoc] |= changeSpeed;
+    }
+
+    /* A speed set by others ends a running ramp. */
+    m_ActiveRamps[m_ActiveLoc].Target = Speed;
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::RampSet(uint16_t Acceleration, uint16_t Deceleration)
+{
+    m_ActiveRamps[m_ActiveLoc].Acceleration = Acceleration;
+    m_ActiveRamps[m_ActiveLoc].Deceleration = Deceleration;
+    m_ActiveRamps[m_ActiveLoc].Target       = m_LocLibData->Speed;
+    m_ActiveRamps[m_ActiveLoc].Timed        = false;
+}
+
+/***********************************************************************************************************************
+ */
+uint16_t LocLib::RampTargetGet(void) { return (m_ActiveRamps[m_ActiveLoc].Target); }
+
+/***********************************************************************************************************************
+ */
+uint8_t LocLib::Tick(uint32_t Now)
+{
+    uint8_t Active;
+    uint8_t Changed = 0;
+    uint16_t Steps;
+    uint16_t Rate;
+    uint32_t Elapsed;
+    LocRamp* Ramp;
+    LocLibData* Data;
+
+    for (Active = 0; Active < m_NumberOfActiveLocs; Active++)
     {
-        switch (m_LocLibData.Steps)
+        Ramp        = &m_ActiveRamps[Active];
+        Data        = &m_ActiveLocs[Active];
+        Elapsed     = (Ramp->Timed == true) ? (Now - Ramp->Time) : 0;
+        Ramp->Time  = Now;
+        Ramp->Timed = true;
+
+        if (Ramp->Target > SpeedStepsMax[Data->Steps])
         {
-        case decoderStep14:
-            if (Speed > 14)
-            {
-                Speed = 14;
-            }
-            break;
-        case decoderStep28:
-            if (Speed > 28)
+            Ramp->Target = SpeedStepsMax[Data->Steps];
+        }
+
+        if (Data->Speed == Ramp->Target)
+        {
+            Ramp->Rest = 0;
+        }
+        else
+        {
+            Rate  = (Ramp->Target > Data->Speed) ? Ramp->Acceleration : Ramp->Deceleration;
+            Steps = 0xFFFF;
+            if (Rate != 0)
             {
-                Speed = 28;
+                /* The full range of the decoder steps takes Rate ms, the rest is counted in ms * steps so no time is
+                 * lost by rounding. A longer interval than the full ramp is not needed. */
+                if (Elapsed > Rate)
+                {
+                    Elapsed = Rate;
+                }
+                Ramp->Rest += Elapsed * SpeedStepsMax[Data->Steps];
+                Steps      = (uint16_t)(Ramp->Rest / Rate);
+                Ramp->Rest = Ramp->Rest % Rate;
             }
-            break;
-        case decoderStep128:
-            if (Speed > 127)
+
+            /* Steps passed since the last tick are sent as one speed. */
+            if (Steps > 0)
             {
-                Speed = 127;
+                if (Ramp->Target > Data->Speed)
+                {
+                    Data->Speed = ((Ramp->Target - Data->Speed) > Steps) ? (Data->Speed + Steps) : Ramp->Target;
+                }
+                else
+                {
+                    Data->Speed = ((Data->Speed - Ramp->Target) > Steps) ? (Data->Speed - Steps) : Ramp->Target;
+                }
+                Changed |= (1 << Active);
+                m_ActiveChanges[Active] |= changeSpeed;
             }
-            break;
         }
     }
 
-    return (Speed);
+    return (Changed);
 }
 
 /***********************************************************************************************************************
  */
-uint8_t LocLib::SpeedGet(void) { return (m_LocLibData.Speed); }
+uint16_t LocLib::ConsumeChanges(void) { return (ConsumeChanges(m_ActiveLoc)); }
 
 /***********************************************************************************************************************
  */
-void LocLib::SpeedUpdate(uint8_t Speed) { m_LocLibData.Speed = Speed; }
+uint16_t LocLib::ConsumeChanges(uint8_t ActiveIndex)
+{
+    uint16_t Changes = 0;
+
+    if (ActiveIndex < m_NumberOfActiveLocs)
+    {
+        Changes                      = m_ActiveChanges[ActiveIndex];
+        m_ActiveChanges[ActiveIndex] = 0;
+    }
+
+    return (Changes);
+}
 
 /***********************************************************************************************************************
  */
-void LocLib::DecoderStepsUpdate(decoderSteps Steps) { m_LocLibData.Steps = Steps; }
+void LocLib::DecoderStepsUpdate(decoderSteps Steps)
+{
+    if (m_LocLibData->Steps != Steps)
+    {
+        m_LocLibData->Steps = Steps;
+        m_ActiveChanges[m_ActiveLoc] |= changeSteps;
+    }
+}
 
 /***********************************************************************************************************************
  */
-decoderSteps LocLib::DecoderStepsGet(void) { return (m_LocLibData.Steps); }
+decoderSteps LocLib::DecoderStepsGet(void) { return (m_LocLibData->Steps); }
 
 /***********************************************************************************************************************
  */
 void LocLib::DirectionToggle(void)
 {
-    if (m_LocLibData.Dir == directionForward)
+    if (m_LocLibData->Dir == directionForward)
     {
-        m_LocLibData.Dir = directionBackWard;
+        m_LocLibData->Dir = directionBackWard;
     }
     else
     {
-        m_LocLibData.Dir = directionForward;
+        m_LocLibData->Dir = directionForward;
     }
+    m_ActiveChanges[m_ActiveLoc] |= changeDirection;
 }
 
 /***********************************************************************************************************************
  */
-direction LocLib::DirectionGet(void) { return (m_LocLibData.Dir); }
+direction LocLib::DirectionGet(void) { return (m_LocLibData->Dir); }
+
+/***********************************************************************************************************************
+ */
+void LocLib::DirectionSet(direction dir)
+{
+    if (m_LocLibData->Dir != dir)
+    {
+        m_LocLibData->Dir = dir;
+        m_ActiveChanges[m_ActiveLoc] |= changeDirection;
+    }
+}
 
 /***********************************************************************************************************************
  */
-void LocLib::DirectionSet(direction dir) { m_LocLibData.Dir = dir; }
+void LocLib::FunctionUpdate(uint32_t FunctionData)
+{
+    LocLibFunctions Functions = m_LocLibData->Function;
+
+    Functions.LowSet(FunctionData);
+    FunctionsUpdate(&Functions);
+}
 
 /***********************************************************************************************************************
  */
-void LocLib::FunctionUpdate(uint32_t FunctionData) { m_LocLibData.Function = FunctionData; }
+void LocLib::FunctionsUpdate(const LocLibFunctions* Functions)
+{
+    m_ActiveChanges[m_ActiveLoc] |= function_changes(&m_LocLibData->Function, Functions);
+    m_LocLibData->Function = *Functions;
+}
 
 /***********************************************************************************************************************
  */
-void LocLib::FunctionToggle(uint8_t number) { m_LocLibData.Function ^= (1 << number); }
+void LocLib::FunctionToggle(uint8_t number)
+{
+    LocLibFunctions Functions = m_LocLibData->Function;
+
+    Functions.Toggle(number);
+    FunctionsUpdate(&Functions);
+}
 
 /***********************************************************************************************************************
  */
@@ -246,9 +616,9 @@ uint8_t LocLib::FunctionAssignedGet(uint8_t number)
 {
     uint8_t Index = 255;
 
-    if (number < 5)
+    if (number < FunctionButtons)
     {
-        Index = m_LocLibData.FunctionAssignment[number];
+        Index = m_LocLibData->FunctionAssignment[number];
     }
 
     return (Index);
@@ -258,24 +628,15 @@ uint8_t LocLib::FunctionAssignedGet(uint8_t number)
  */
 bool LocLib::FunctionAssignedGetStored(uint16_t address, uint8_t* functions)
 {
-    bool Found    = false;
-    uint8_t Index = 0;
+    bool Found     = false;
+    uint16_t Index = CheckLoc(address);
     LocLibData Data;
 
-    while ((Index < m_NumberOfLocs) && (Found == false))
+    if (Index != LocNotFound)
     {
-        // Read data from EEPROM and check address.
-        m_LocStorage.LocDataGet(&Data, Index);
-
-        if (Data.Addres == address)
-        {
-            Found = true;
-            memcpy(functions, Data.FunctionAssignment, 5);
-        }
-        else
-        {
-            Index++;
-        }
+        LocDataRead(&Data, Index);
+        memcpy(functions, Data.FunctionAssignment, sizeof(Data.FunctionAssignment));
+        Found = true;
     }
 
     return (Found);
@@ -287,9 +648,9 @@ LocLib::function LocLib::FunctionStatusGet(uint32_t number)
 {
     function Result = functionNone;
 
-    if (number <= 28)
+    if (number < LOC_LIB_FUNCTIONS)
     {
-        if (m_LocLibData.Function & (1 << number))
+        if (m_LocLibData->Function.Get((uint8_t)(number)) == true)
         {
             Result = functionOn;
         }
@@ -302,76 +663,155 @@ LocLib::function LocLib::FunctionStatusGet(uint32_t number)
     return (Result);
 }
 
+/***********************************************************************************************************************
+ */
+uint8_t LocLib::SpeedInstructionGet(protocol Protocol, uint8_t* Data)
+{
+    uint8_t Length = 0;
+    uint8_t Code;
+    uint8_t Forward = (m_LocLibData->Dir == directionForward) ? 1 : 0;
+    uint16_t Speed  = m_LocLibData->Speed;
+
+    if (Speed > SpeedStepsMax[m_LocLibData->Steps])
+    {
+        Speed = SpeedStepsMax[m_LocLibData->Steps];
+    }
+
+    switch (m_LocLibData->Steps)
+    {
+    case decoderStep14: Code = SpeedCode14[Speed]; break;
+    case decoderStep28: Code = SpeedCode28[Speed]; break;
+    default: Code = (Speed == 0) ? 0 : ((Speed < 126) ? (uint8_t)(Speed + 1) : 127); break;
+    }
+
+    if (Protocol == protocolXpressNet)
+    {
+        Data[Length++] = 0xE4;
+        Data[Length++] = SpeedXpNetId[m_LocLibData->Steps];
+        Length += instruction_address(Protocol, m_LocLibData->Addres, &Data[Length]);
+        Data[Length++] = (Forward << 7) | Code;
+    }
+    else
+    {
+        Length += instruction_address(Protocol, m_LocLibData->Addres, &Data[Length]);
+        if (m_LocLibData->Steps == decoderStep128)
+        {
+            Data[Length++] = 0x3F;
+            Data[Length++] = (Forward << 7) | Code;
+        }
+        else
+        {
+            /* 14 steps: F0 is sent in bit 4 of the speed instruction. */
+            Data[Length] = 0x40 | (Forward << 5) | Code;
+            if (m_LocLibData->Steps == decoderStep14)
+            {
+                Data[Length] |= (m_LocLibData->Function.Get(0) == true) ? 0x10 : 0;
+            }
+            Length++;
+        }
+    }
+
+    return (instruction_check(Data, Length));
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t LocLib::FunctionInstructionGet(protocol Protocol, functionGroup Group, uint8_t* Data)
+{
+    const FunctionGroupCode* Code = &FunctionGroups[Group];
+    uint8_t Length                = 0;
+    uint8_t Bits                  = m_LocLibData->Function.Group(Code->First) & Code->Mask;
+
+    if ((Group == functionGroup1) && (m_LocLibData->Function.Get(0) == true))
+    {
+        Bits |= 0x10;
+    }
+
+    if (Protocol == protocolXpressNet)
+    {
+        Data[Length++] = 0xE4;
+        Data[Length++] = Code->XpNetId;
+        Length += instruction_address(Protocol, m_LocLibData->Addres, &Data[Length]);
+        Data[Length++] = Bits;
+    }
+    else
+    {
+        Length += instruction_address(Protocol, m_LocLibData->Addres, &Data[Length]);
+        if (Code->Mask == 0xFF)
+        {
+            Data[Length++] = Code->DccInstruction;
+            Data[Length++] = Bits;
+        }
+        else
+        {
+            Data[Length++] = Code->DccInstruction | Bits;
+        }
+    }
+
+    return (instruction_check(Data, Length));
+}
+
 /***********************************************************************************************************************
  */
 uint16_t LocLib::GetNextLoc(int8_t Delta)
 {
+    uint16_t Position;
+
     if (Delta != 0)
     {
+        Position = PositionBySlot(m_ActualSelectedLoc);
+
         /* Increase or decrease locindex, and if required roll over from begin to
          * end or end to begin. */
         if (Delta > 0)
         {
-            m_ActualSelectedLoc++;
+            Position++;
 
-            if (m_ActualSelectedLoc >= m_NumberOfLocs)
+            if (Position >= m_NumberOfLocs)
             {
-                m_ActualSelectedLoc = 0;
+                Position = 0;
             }
         }
         else
         {
-            if (m_ActualSelectedLoc == 0)
+            if (Position == 0)
             {
-                m_ActualSelectedLoc = (m_NumberOfLocs - 1);
+                Position = (m_NumberOfLocs - 1);
             }
             else
             {
-                m_ActualSelectedLoc--;
+                Position--;
             }
         }
 
-        m_LocStorage.LocDataGet(&m_LocLibData, m_ActualSelectedLoc);
+        ActiveLocLoad(SlotByPosition(Position));
         m_LocStorage.SelectedLocIndexStore(m_ActualSelectedLoc);
     }
 
-    return (m_LocLibData.Addres);
+    return (m_LocLibData->Addres);
 }
 
 /***********************************************************************************************************************
  */
-uint16_t LocLib::GetActualLocAddress(void) { return (m_LocLibData.Addres); }
+uint16_t LocLib::GetActualLocAddress(void) { return (m_LocLibData->Addres); }
 
 /***********************************************************************************************************************
  */
-char* LocLib::GetLocName(void) { return (m_LocLibData.Name); }
+char* LocLib::GetLocName(void) { return (m_LocLibData->Name); }
 
 /***********************************************************************************************************************
  */
-uint8_t LocLib::CheckLoc(uint16_t address)
+uint16_t LocLib::CheckLoc(uint16_t address)
 {
-    bool Found    = false;
-    uint8_t Index = 0;
-    LocLibData Data;
-
-    while ((Index < m_NumberOfLocs) && (Found == false))
-    {
-        // Read data from EEPROM and check address.
-        m_LocStorage.LocDataGet(&Data, Index);
-
-        if (Data.Addres == address)
-        {
-            Found = true;
-        }
-        else
-        {
-            Index++;
-        }
-    }
+    bool Found;
+    uint16_t Index = LocNotFound;
+    uint16_t Position;
 
-    if (Index >= m_NumberOfLocs)
+    /* Lookup in the address index, no EEPROM access required. */
+    Position = LocIndexSearch(address, &Found);
+    if (Found == true)
     {
-        Index = 255;
+        Index = m_LocIndex[Position].Slot;
     }
 
     return (Index);
@@ -382,32 +822,42 @@ uint8_t LocLib::CheckLoc(uint16_t address)
 bool LocLib::StoreLoc(uint16_t address, uint8_t* FunctionAssignment, char* Name, store storeAction)
 {
     LocLibData Data;
-    uint8_t LocIndex;
+    uint16_t LocIndex;
+    uint16_t Slot;
+    uint8_t Active;
     bool Result = false;
 
     LocIndex = CheckLoc(address);
 
     /* Check if loc is already present in eeprom. */
-    if (LocIndex != 255)
+    if (LocIndex != LocNotFound)
     {
         if (storeAction == storeChange)
         {
             /* Read data, update function data and store. */
-            m_LocStorage.LocDataGet(&Data, LocIndex);
+            LocDataRead(&Data, LocIndex);
 
             if (Name != NULL)
             {
                 memset(Data.Name, '\0', sizeof(Data.Name));
-                memcpy(Data.Name, Name, sizeof(Data.Name) - 1);
+                strncpy(Data.Name, Name, sizeof(Data.Name) - 1);
             }
             if (FunctionAssignment != NULL)
             {
                 memcpy(Data.FunctionAssignment, FunctionAssignment, sizeof(Data.FunctionAssignment));
             }
 
-            m_LocStorage.LocDataSet(&Data, LocIndex);
+            /* Fails when the functions above F31 do not fit, the other data is stored. */
+            Result = LocDataWrite(&Data, LocIndex);
 
-            Result = true;
+            /* Keep an active copy of the loc up to date, the live state is not changed. */
+            Active = ActiveLocFind(LocIndex);
+            if (Active != 255)
+            {
+                memcpy(m_ActiveLocs[Active].Name, Data.Name, sizeof(Data.Name));
+                memcpy(m_ActiveLocs[Active].FunctionAssignment, Data.FunctionAssignment,
+                    sizeof(Data.FunctionAssignment));
+            }
         }
     }
     else
@@ -424,25 +874,28 @@ bool LocLib::StoreLoc(uint16_t address, uint8_t* FunctionAssignment, char* Name,
                 Data.Steps    = decoderStep28;
                 Data.Dir      = directionForward;
                 Data.Speed    = 0;
-                Data.Function = 0;
+                memset(&Data.Function, 0, sizeof(Data.Function));
 
                 memset(Data.Name, '\0', sizeof(Data.Name));
                 if (Name != NULL)
                 {
-                    memcpy(Data.Name, Name, sizeof(Data.Name) - 1);
+                    strncpy(Data.Name, Name, sizeof(Data.Name) - 1);
                 }
 
                 memcpy(Data.FunctionAssignment, FunctionAssignment, sizeof(Data.FunctionAssignment));
-                m_NumberOfLocs++;
 
-                m_LocStorage.NumberOfLocsSet(m_NumberOfLocs);
-                m_LocStorage.LocDataSet(&Data, m_NumberOfLocs - 1);
+                /* Write the loc data before the slot is marked as occupied. */
+                Slot = (m_SortedInsert == true) ? SlotSorted(address) : SlotFree();
+                LocDataWrite(&Data, Slot);
+                SlotUsedSet(Slot, true);
+
+                LocIndexInsert(address, Slot);
+                m_NumberOfLocs++;
 
                 /* Get newly added loc data. */
                 if (storeAction == storeAdd)
                 {
-                    m_ActualSelectedLoc = m_NumberOfLocs - 1;
-                    m_LocStorage.LocDataGet(&m_LocLibData, m_ActualSelectedLoc);
+                    ActiveLocLoad(Slot);
                 }
                 Result = true;
             }
@@ -459,42 +912,46 @@ bool LocLib::StoreLoc(uint16_t address, uint8_t* FunctionAssignment, char* Name,
 bool LocLib::RemoveLoc(uint16_t address)
 {
     bool Result = false;
-    LocLibData Data;
-    uint8_t LocIndex;
-    uint8_t Index;
+    uint16_t LocIndex;
+    uint16_t Position;
+    uint8_t Active;
 
     /* If at least two locs are present delete loc. */
     if (m_NumberOfLocs > 1)
     {
         LocIndex = CheckLoc(address);
 
-        /* If loc is present delete it. */
-        if (LocIndex != 255)
+        /* If loc is present delete it, only the slot is marked as free. */
+        if (LocIndex != LocNotFound)
         {
-            Index = LocIndex;
-            /* Copy data next loc to this location so loc is removed. */
-            while ((Index + 1) < m_NumberOfLocs)
-            {
-                m_LocStorage.LocDataGet(&Data, Index + 1);
-                m_LocStorage.LocDataSet(&Data, Index);
-                Index++;
-            }
+            Position = PositionBySlot(LocIndex);
 
+            SlotUsedSet(LocIndex, false);
+            LocIndexRemove(LocIndex);
             m_NumberOfLocs--;
-            m_LocStorage.NumberOfLocsSet(m_NumberOfLocs);
 
             Result = true;
 
-            /* Load data for "next" loc... */
-            if (LocIndex < m_NumberOfLocs)
+            Active = ActiveLocFind(LocIndex);
+            if (Active == m_ActiveLoc)
             {
-                m_LocStorage.LocDataGet(&m_LocLibData, LocIndex);
+                /* Selected loc deleted, load data for "next" loc... */
+                if (Position >= m_NumberOfLocs)
+                {
+                    /* Last item in list was deleted. */
+                    Position = m_NumberOfLocs - 1;
+                }
+
+                ActiveLocLoad(SlotByPosition(Position));
+                if (m_ActiveLoc != Active)
+                {
+                    /* "Next" loc was already active. */
+                    ActiveLocDrop(Active);
+                }
             }
-            else
+            else if (Active != 255)
             {
-                /* Last item in list was deleted. */
-                m_LocStorage.LocDataGet(&m_LocLibData, m_NumberOfLocs - 1);
-                m_ActualSelectedLoc = m_NumberOfLocs - 1;
+                ActiveLocDrop(Active);
             }
         }
     }
@@ -504,7 +961,222 @@ bool LocLib::RemoveLoc(uint16_t address)
 
 /***********************************************************************************************************************
  */
-void LocLib::RemoveAllLocs(void) { m_NumberOfLocs = 1; }
+void LocLib::RemoveAllLocs(void)
+{
+    uint16_t Index;
+    uint8_t Active;
+    uint16_t Slot = SlotByPosition(0);
+
+    /* Only the first loc remains. */
+    for (Index = 0; Index < m_NumberOfLocs; Index++)
+    {
+        if (m_LocIndex[Index].Slot == Slot)
+        {
+            m_LocIndex[0] = m_LocIndex[Index];
+            break;
+        }
+    }
+
+    memset(m_SlotMap, 0, sizeof(m_SlotMap));
+    m_SlotMap[Slot / 8] |= (1 << (Slot % 8));
+    m_LocStorage.SlotMapSet(m_SlotMap, 0, sizeof(m_SlotMap));
+
+    m_NumberOfLocs = 1;
+
+    /* The remaining loc is the only active loc, keep its live state when it was active. */
+    Active = ActiveLocFind(Slot);
+    if (Active == 255)
+    {
+        LocDataRead(&m_ActiveLocs[0], Slot);
+        ActiveLocStart(0);
+    }
+    else if (Active != 0)
+    {
+        memcpy(&m_ActiveLocs[0], &m_ActiveLocs[Active], sizeof(LocLibData));
+        m_ActiveRamps[0]   = m_ActiveRamps[Active];
+        m_ActiveChanges[0] = m_ActiveChanges[Active];
+    }
+    m_NumberOfActiveLocs = 1;
+    m_ActiveSlots[0]     = Slot;
+    ActiveLocSelectSet(0);
+}
+
+/***********************************************************************************************************************
+ */
+bool LocLib::Export(ExportSink Sink, void* Context)
+{
+    uint8_t Header[LOCLIB_IMAGE_HEADER_SIZE];
+    uint8_t Record[LOC_STORAGE_RECORD_SIZE_MAX];
+    uint8_t Trailer[LOCLIB_IMAGE_CRC_SIZE];
+    uint32_t Crc = 0xFFFFFFFF;
+    uint16_t Slot;
+    LocLibData Data;
+    bool Result;
+
+    memcpy(Header, LOCLIB_IMAGE_MAGIC, 4);
+    Header[4]  = LOCLIB_IMAGE_VERSION;
+    Header[5]  = LOC_STORAGE_RECORD_SIZE;
+    Header[6]  = (m_AcOption == true) ? 1 : 0;
+    Header[7]  = (m_LocStorage.EmergencyOptionGet() == true) ? 1 : 0;
+    Header[8]  = (uint8_t)(m_NumberOfLocs & 0xFF);
+    Header[9]  = (uint8_t)(m_NumberOfLocs >> 8);
+    Header[10] = LOC_LIB_NAME_LENGTH;
+    Header[11] = LOC_LIB_FUNCTION_BUTTONS;
+    Result     = image_write(Sink, Context, Header, sizeof(Header), &Crc);
+
+    /* Occupied slots in ascending order is the list order. */
+    for (Slot = 0; (Slot < MaxNumberOfLocs) && (Result == true); Slot++)
+    {
+        if (SlotUsed(Slot) == true)
+        {
+            LocDataRead(&Data, Slot);
+            LocStorage::RecordEncode(&Data, Record);
+            Result = image_write(Sink, Context, Record, LocStorage::RecordSize(Record), &Crc);
+        }
+    }
+
+    if (Result == true)
+    {
+        Crc        = ~Crc;
+        Trailer[0] = (uint8_t)(Crc & 0xFF);
+        Trailer[1] = (uint8_t)((Crc >> 8) & 0xFF);
+        Trailer[2] = (uint8_t)((Crc >> 16) & 0xFF);
+        Trailer[3] = (uint8_t)(Crc >> 24);
+        Result     = Sink(Trailer, sizeof(Trailer), Context);
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+bool LocLib::Import(ImportSource Source, void* Context)
+{
+    uint8_t Header[LOCLIB_IMAGE_HEADER_SIZE];
+    uint8_t Record[LOC_STORAGE_RECORD_SIZE_MAX];
+    uint8_t Trailer[LOCLIB_IMAGE_CRC_SIZE];
+    uint32_t Crc = 0xFFFFFFFF;
+    uint16_t Count;
+    uint16_t Slot;
+    LocLibData Data;
+    bool Found;
+    bool Result;
+
+    Result = image_read(Source, Context, Header, LOCLIB_IMAGE_HEADER_SIZE_BASE, &Crc);
+    if ((Result == true) && (Header[4] == LOCLIB_IMAGE_VERSION))
+    {
+        Result = image_read(Source, Context, &Header[LOCLIB_IMAGE_HEADER_SIZE_BASE],
+            LOCLIB_IMAGE_HEADER_SIZE - LOCLIB_IMAGE_HEADER_SIZE_BASE, &Crc);
+    }
+    else
+    {
+        /* Older images only come from the default record format. */
+        Header[10] = LOCLIB_IMAGE_NAME_LENGTH_BASE;
+        Header[11] = LOCLIB_IMAGE_BUTTONS_BASE;
+    }
+
+    /* The record size alone does not tell apart a longer name from more buttons. */
+    Count = (uint16_t)(Header[8]) | ((uint16_t)(Header[9]) << 8);
+    if ((Result == false) || (memcmp(Header, LOCLIB_IMAGE_MAGIC, 4) != 0)
+        || ((Header[4] != LOCLIB_IMAGE_VERSION) && (Header[4] != LOCLIB_IMAGE_VERSION_EXT)
+            && (Header[4] != LOCLIB_IMAGE_VERSION_BASE))
+        || (Header[5] != LOC_STORAGE_RECORD_SIZE) || (Header[10] != LOC_LIB_NAME_LENGTH)
+        || (Header[11] != LOC_LIB_FUNCTION_BUTTONS) || (Count == 0) || (Count > MaxNumberOfLocs))
+    {
+        /* Nothing written yet, keep the stored locs. */
+        return (false);
+    }
+
+    m_LocStorage.TransactionBegin();
+
+    /* Free the slots which are overwritten first, when the import is interrupted only complete locs remain. */
+    for (Slot = 0; Slot < Count; Slot++)
+    {
+        m_SlotMap[Slot / 8] &= ~(1 << (Slot % 8));
+    }
+    m_LocStorage.SlotMapSet(m_SlotMap, 0, (Count + 7) / 8);
+
+    /* The locs are written to the first slots, the index is built while reading to detect double addresses. */
+    m_NumberOfLocs = 0;
+    for (Slot = 0; (Slot < Count) && (Result == true); Slot++)
+    {
+        Result = image_read(Source, Context, Record, LOC_STORAGE_RECORD_SIZE, &Crc);
+        if ((Result == true) && (LocStorage::RecordSize(Record) > LOC_STORAGE_RECORD_SIZE))
+        {
+            Result = image_read(Source, Context, &Record[LOC_STORAGE_RECORD_SIZE], LOC_STORAGE_RECORD_EXT_SIZE, &Crc);
+        }
+        if (Result == true)
+        {
+            LocStorage::RecordDecode(Record, &Data);
+            LocIndexSearch(Data.Addres, &Found);
+            if ((Found == true) || (Data.Addres < ADDRESS_LOC_MIN) || (Data.Addres > ADDRESS_LOC_MAX))
+            {
+                Result = false;
+            }
+            else if (LocDataWrite(&Data, Slot) == false)
+            {
+                /* No room for the functions above F31 of this loc. */
+                Result = false;
+            }
+            else
+            {
+                LocIndexInsert(Data.Addres, Slot);
+                m_NumberOfLocs++;
+            }
+        }
+    }
+
+    if (Result == true)
+    {
+        Crc    = ~Crc;
+        Result = (Source(Trailer, sizeof(Trailer), Context) == sizeof(Trailer))
+            && (Trailer[0] == (uint8_t)(Crc & 0xFF)) && (Trailer[1] == (uint8_t)((Crc >> 8) & 0xFF))
+            && (Trailer[2] == (uint8_t)((Crc >> 16) & 0xFF)) && (Trailer[3] == (uint8_t)(Crc >> 24));
+    }
+
+    if (Result == true)
+    {
+        memset(m_SlotMap, 0, sizeof(m_SlotMap));
+        for (Slot = 0; Slot < Count; Slot++)
+        {
+            m_SlotMap[Slot / 8] |= (1 << (Slot % 8));
+        }
+        m_LocStorage.SlotMapSet(m_SlotMap, 0, sizeof(m_SlotMap));
+
+        m_AcOption = (Header[6] == 1);
+        m_LocStorage.AcOptionSet((Header[6] == 1) ? 1 : 0);
+        m_LocStorage.EmergencyOptionSet((Header[7] == 1) ? 1 : 0);
+    }
+
+    m_LocStorage.TransactionEnd();
+
+    if (Result == false)
+    {
+        /* The slot map contains the remaining locs. */
+        LocIndexBuild();
+        if (m_NumberOfLocs == 0)
+        {
+            InitialLocStore();
+        }
+    }
+
+    /* The image is in list order, which is not necessarily sorted. */
+    if (m_SortedInsert == true)
+    {
+        LocSortedRestore();
+    }
+
+    /* The first loc is the only active loc. */
+    Slot                 = SlotByPosition(0);
+    m_NumberOfActiveLocs = 1;
+    m_ActiveSlots[0]     = Slot;
+    ActiveLocSelectSet(0);
+    LocDataRead(m_LocLibData, Slot);
+    ActiveLocStart(0);
+    m_LocStorage.SelectedLocIndexStore(Slot);
+
+    return (Result);
+}
 
 /***********************************************************************************************************************
  */
@@ -512,51 +1184,267 @@ uint16_t LocLib::GetNumberOfLocs(void) { return (m_NumberOfLocs); }
 
 /***********************************************************************************************************************
  */
-uint8_t LocLib::GetActualSelectedLocIndex(void) { return (m_ActualSelectedLoc + 1); }
+uint16_t LocLib::GetActualSelectedLocIndex(void) { return (PositionBySlot(m_ActualSelectedLoc) + 1); }
 
 /***********************************************************************************************************************
  */
 void LocLib::LocBubbleSort(void)
 {
-    int i, j;
-    LocLibData Data_1;
-    LocLibData Data_2;
-    LocLibData DataTemp;
+    uint16_t Sources[MaxNumberOfLocs];
+    uint16_t Index;
+    uint16_t Selected = m_ActualSelectedLoc;
+
+    /* The address index is already sorted, entry n holds the slot of the loc which must be moved to slot n. */
+    for (Index = 0; Index < m_NumberOfLocs; Index++)
+    {
+        Sources[Index]         = m_LocIndex[Index].Slot;
+        m_LocIndex[Index].Slot = Index;
+    }
+    for (Index = m_NumberOfLocs; Index < MaxNumberOfLocs; Index++)
+    {
+        Sources[Index] = LocNotFound;
+    }
+
+    ActiveLocSlotsRemap(Sources);
+    LocSlotsMove(Sources);
+
+    if (m_ActualSelectedLoc != Selected)
+    {
+        m_LocStorage.SelectedLocIndexStore(m_ActualSelectedLoc);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::LocCompact(void)
+{
+    uint16_t Sources[MaxNumberOfLocs];
+    uint16_t Index;
+    uint16_t Slot;
+    uint16_t Selected = m_ActualSelectedLoc;
+
+    /* Keep the order of the locs, the n-th occupied slot is moved to slot n. */
+    Index = 0;
+    for (Slot = 0; Slot < MaxNumberOfLocs; Slot++)
+    {
+        if (SlotUsed(Slot) == true)
+        {
+            Sources[Index] = Slot;
+            Index++;
+        }
+    }
+    for (; Index < MaxNumberOfLocs; Index++)
+    {
+        Sources[Index] = LocNotFound;
+    }
+
+    for (Index = 0; Index < m_NumberOfLocs; Index++)
+    {
+        m_LocIndex[Index].Slot = PositionBySlot(m_LocIndex[Index].Slot);
+    }
+
+    ActiveLocSlotsRemap(Sources);
+    LocSlotsMove(Sources);
+
+    if (m_ActualSelectedLoc != Selected)
+    {
+        m_LocStorage.SelectedLocIndexStore(m_ActualSelectedLoc);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::SortedInsertSet(bool Enable)
+{
+    m_SortedInsert = Enable;
+    if (m_SortedInsert == true)
+    {
+        LocSortedRestore();
+    }
+}
+
+/***********************************************************************************************************************
+ */
+bool LocLib::SortedInsertGet(void) { return (m_SortedInsert); }
+
+/***********************************************************************************************************************
+ */
+LocLibData* LocLib::LocGetAllDataByIndex(uint16_t Index)
+{
+    uint16_t Slot = SlotByPosition(Index);
+
+    if (Slot != LocNotFound)
+    {
+        LocDataRead(&m_LocLibDataRead, Slot);
+    }
+    return (&m_LocLibDataRead);
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::LocCursorStart(LocLibCursor* Cursor, uint16_t Position)
+{
+    Cursor->Position = Position;
+    Cursor->Slot     = 0;
+
+    if (m_SortedInsert == false)
+    {
+        /* The only search of the walk, the next locs are found from the slot of the previous loc. */
+        Cursor->Slot = SlotByPosition(Position);
+    }
+}
+
+/***********************************************************************************************************************
+ * Each record is read with its own read, as in ResidentLoad() a read over the unused bytes between records costs
+ * more than the extra address phases.
+ */
+bool LocLib::LocCursorNext(LocLibCursor* Cursor, LocLibData* DataPtr)
+{
+    uint16_t Slot = LocNotFound;
+    bool Result   = false;
+#if LOCLIB_RESIDENT == 0
+    uint8_t Record[LOC_STORAGE_RECORD_SIZE_MAX];
+#endif
 
-    for (i = 0; i < (m_NumberOfLocs - 1); ++i)
+    if (Cursor->Position < m_NumberOfLocs)
     {
-        for (j = 0; (j < m_NumberOfLocs - 1 - i); ++j)
+        if (m_SortedInsert == true)
+        {
+            Slot = m_LocIndex[Cursor->Position].Slot;
+        }
+        else
         {
-            m_LocStorage.LocDataGet(&Data_1, j);
-            m_LocStorage.LocDataGet(&Data_2, (j + 1));
+            /* Empty bytes of the slot map are skipped at once. */
+            Slot = Cursor->Slot;
+            while ((Slot < MaxNumberOfLocs) && (SlotUsed(Slot) == false))
+            {
+                if (((Slot % 8) == 0) && (m_SlotMap[Slot / 8] == 0))
+                {
+                    Slot += 8;
+                }
+                else
+                {
+                    Slot++;
+                }
+            }
+        }
+    }
+
+    if (Slot < MaxNumberOfLocs)
+    {
+        /* Read without the cache, a walk would replace the cached locs in use. */
+#if LOCLIB_RESIDENT == 1
+        LocStorage::RecordDecode(m_Records[Slot], DataPtr);
+#else
+        m_LocStorage.RecordRead(Record, Slot);
+        LocStorage::RecordDecode(Record, DataPtr);
+#endif
+        Cursor->Position++;
+        Cursor->Slot = Slot + 1;
+        Result       = true;
+    }
+
+    return (Result);
+}
 
-            if (Data_1.Addres > Data_2.Addres)
+/***********************************************************************************************************************
+ */
+uint8_t LocLib::ActiveLocAdd(uint16_t address)
+{
+    uint16_t Slot  = CheckLoc(address);
+    uint8_t Active = 255;
+
+    if (Slot != LocNotFound)
+    {
+        Active = ActiveLocFind(Slot);
+        if (Active == 255)
+        {
+            if (m_NumberOfActiveLocs < MaxActiveLocs)
             {
-                memcpy(&DataTemp, &Data_2, sizeof(LocLibData));
-                memcpy(&Data_2, &Data_1, sizeof(LocLibData));
-                memcpy(&Data_1, &DataTemp, sizeof(LocLibData));
-                m_LocStorage.LocDataSet(&Data_1, j);
-                m_LocStorage.LocDataSet(&Data_2, (j + 1));
+                /* Loc enters the active locs, the only moment its data is read. */
+                Active = m_NumberOfActiveLocs;
+                LocDataRead(&m_ActiveLocs[Active], Slot);
+                m_ActiveSlots[Active] = Slot;
+                m_NumberOfActiveLocs++;
+
+                /* The momentum of the selected loc is taken over. */
+                m_ActiveRamps[Active] = m_ActiveRamps[m_ActiveLoc];
+                ActiveLocStart(Active);
             }
         }
+
+        if (Active != 255)
+        {
+            ActiveLocSelectSet(Active);
+            m_LocStorage.SelectedLocIndexStore(m_ActualSelectedLoc);
+        }
+    }
+
+    return (Active);
+}
+
+/***********************************************************************************************************************
+ */
+bool LocLib::ActiveLocRemove(uint8_t ActiveIndex)
+{
+    bool Result = false;
+
+    if ((ActiveIndex < m_NumberOfActiveLocs) && (m_NumberOfActiveLocs > 1))
+    {
+        if (ActiveIndex == m_ActiveLoc)
+        {
+            ActiveLocSelectSet((ActiveIndex == 0) ? 1 : 0);
+        }
+
+        ActiveLocDrop(ActiveIndex);
+        Result = true;
     }
+
+    return (Result);
 }
 
 /***********************************************************************************************************************
  */
-LocLibData* LocLib::LocGetAllDataByIndex(uint8_t Index)
+bool LocLib::ActiveLocSelect(uint8_t ActiveIndex)
 {
-    m_LocStorage.LocDataGet(&m_LocLibData, Index);
-    return (&m_LocLibData);
+    bool Result = false;
+
+    if (ActiveIndex < m_NumberOfActiveLocs)
+    {
+        ActiveLocSelectSet(ActiveIndex);
+        Result = true;
+    }
+
+    return (Result);
 }
 
 /***********************************************************************************************************************
  */
-uint16_t LocLib::SpeedIncrease(void)
+uint8_t LocLib::ActiveLocSelectedGet(void) { return (m_ActiveLoc); }
+
+/***********************************************************************************************************************
+ */
+uint8_t LocLib::ActiveLocNumberGet(void) { return (m_NumberOfActiveLocs); }
+
+/***********************************************************************************************************************
+ */
+LocLibData* LocLib::ActiveLocDataGet(uint8_t ActiveIndex)
 {
-    uint16_t Speed = m_LocLibData.Speed;
+    LocLibData* Data = NULL;
+
+    if (ActiveIndex < m_NumberOfActiveLocs)
+    {
+        Data = &m_ActiveLocs[ActiveIndex];
+    }
+
+    return (Data);
+}
 
-    if ((m_LocLibData.Speed >= 20) && (m_LocLibData.Steps == decoderStep128))
+/***********************************************************************************************************************
+ */
+uint16_t LocLib::SpeedIncrease(uint16_t Speed)
+{
+    if ((Speed >= 20) && (m_LocLibData->Steps == decoderStep128))
     {
         Speed += 2;
     }
@@ -570,17 +1458,15 @@ uint16_t LocLib::SpeedIncrease(void)
 
 /***********************************************************************************************************************
  */
-uint16_t LocLib::SpeedDecrease(void)
+uint16_t LocLib::SpeedDecrease(uint16_t Speed)
 {
-    uint16_t Speed = m_LocLibData.Speed;
-
     if (Speed > 0)
     {
-        if ((Speed > 20) && (m_LocLibData.Steps == decoderStep128))
+        if ((Speed > 20) && (m_LocLibData->Steps == decoderStep128))
         {
             Speed -= 2;
         }
-        else if (m_LocLibData.Speed > 0)
+        else
         {
             Speed--;
         }
@@ -594,56 +1480,726 @@ uint16_t LocLib::SpeedDecrease(void)
 uint16_t LocLib::SpeedStopOrChangeDirection(void)
 {
     uint16_t Speed;
-    if (m_LocLibData.Speed != 0)
+    if (m_LocLibData->Speed != 0)
     {
-        Speed              = 0;
-        m_LocLibData.Speed = 0;
+        Speed               = 0;
+        m_LocLibData->Speed = 0;
+        m_ActiveChanges[m_ActiveLoc] |= changeSpeed;
     }
     else
     {
         DirectionToggle();
-        Speed = m_LocLibData.Speed;
+        Speed = m_LocLibData->Speed;
     }
 
     return (Speed);
 }
 
 /***********************************************************************************************************************
- * limit maximum loc addres.
  */
-uint16_t LocLib::limitLocAddress(uint16_t locAddress)
+uint16_t LocLib::SpeedTargetSet(int8_t Delta)
 {
-    uint16_t locAdrresReturn = locAddress;
-    if (locAdrresReturn > ADDRESS_LOC_MAX)
+    LocRamp* Ramp  = &m_ActiveRamps[m_ActiveLoc];
+    uint16_t Speed = 0xFFFF;
+    bool Increase  = (Delta > 0);
+
+    /* Without AC option turning against the direction of the loc decreases the speed. */
+    if ((m_AcOption == false) && (m_LocLibData->Dir == directionBackWard))
     {
-        locAdrresReturn = ADDRESS_LOC_MIN;
+        Increase = (Delta < 0);
     }
-    else if (locAdrresReturn == 0)
+
+    if (Ramp->Target == m_LocLibData->Speed)
     {
-        locAdrresReturn = ADDRESS_LOC_MAX;
+        /* A new ramp starts, the time before it and the rest of the previous ramp are not counted. */
+        Ramp->Rest  = 0;
+        Ramp->Timed = false;
     }
 
-    return (locAdrresReturn);
+    if (Delta == 0)
+    {
+        if (Ramp->Target != 0)
+        {
+            /* Ramp down to stop. */
+            Ramp->Target = 0;
+        }
+        else
+        {
+            /* Stop again while ramping down stops at once, when already stopped change direction. */
+            Speed = SpeedStopOrChangeDirection();
+        }
+    }
+    else if (Increase == true)
+    {
+        Ramp->Target = SpeedIncrease(Ramp->Target);
+        if (Ramp->Target > SpeedStepsMax[m_LocLibData->Steps])
+        {
+            Ramp->Target = SpeedStepsMax[m_LocLibData->Steps];
+        }
+    }
+    else if (Ramp->Target != 0)
+    {
+        Ramp->Target = SpeedDecrease(Ramp->Target);
+    }
+    else if ((m_AcOption == false) && (m_LocLibData->Speed == 0))
+    {
+        /* Direction change only when the loc stands still. */
+        DirectionToggle();
+        Speed = m_LocLibData->Speed;
+    }
+
+    return (Speed);
 }
 
 /***********************************************************************************************************************
  */
-void LocLib::InitialLocStore(void)
+void LocLib::ActiveLocStart(uint8_t ActiveIndex)
 {
-    m_NumberOfLocs                     = 1;
-    m_LocLibData.Addres                = 3;
-    m_LocLibData.Steps                 = decoderStep28;
-    m_LocLibData.Dir                   = directionForward;
-    m_LocLibData.Speed                 = 0;
-    m_ActualSelectedLoc                = 0;
-    m_LocLibData.FunctionAssignment[0] = 0;
-    m_LocLibData.FunctionAssignment[1] = 1;
-    m_LocLibData.FunctionAssignment[2] = 2;
-    m_LocLibData.FunctionAssignment[3] = 3;
-    m_LocLibData.FunctionAssignment[4] = 4;
-    memset(m_LocLibData.Name, '\0', sizeof(m_LocLibData.Name));
-
-    m_LocStorage.LocDataSet(&m_LocLibData, 0);
-    m_LocStorage.SelectedLocIndexStore(0);
-    m_LocStorage.NumberOfLocsSet(1);
+    m_ActiveRamps[ActiveIndex].Target = m_ActiveLocs[ActiveIndex].Speed;
+    m_ActiveRamps[ActiveIndex].Rest   = 0;
+    m_ActiveRamps[ActiveIndex].Timed  = false;
+    m_ActiveChanges[ActiveIndex]      = 0;
+}
+
+/***********************************************************************************************************************
+ * limit maximum loc addres.
+ */
+uint16_t LocLib::limitLocAddress(uint16_t locAddress)
+{
+    uint16_t locAdrresReturn = locAddress;
+    if (locAdrresReturn > ADDRESS_LOC_MAX)
+    {
+        locAdrresReturn = ADDRESS_LOC_MIN;
+    }
+    else if (locAdrresReturn == 0)
+    {
+        locAdrresReturn = ADDRESS_LOC_MAX;
+    }
+
+    return (locAdrresReturn);
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::InitialLocStore(void)
+{
+    uint8_t Button;
+
+    m_NumberOfActiveLocs = 1;
+    m_ActiveSlots[0]     = 0;
+    ActiveLocSelectSet(0);
+
+    m_NumberOfLocs       = 1;
+    m_LocLibData->Addres = 3;
+    m_LocLibData->Steps  = decoderStep28;
+    m_LocLibData->Dir    = directionForward;
+    m_LocLibData->Speed  = 0;
+    for (Button = 0; Button < FunctionButtons; Button++)
+    {
+        m_LocLibData->FunctionAssignment[Button] = Button;
+    }
+    memset(m_LocLibData->Name, '\0', sizeof(m_LocLibData->Name));
+
+    LocDataWrite(m_LocLibData, 0);
+    m_LocStorage.SelectedLocIndexStore(0);
+    m_LocStorage.NumberOfLocsSet(1);
+
+    memset(m_SlotMap, 0, sizeof(m_SlotMap));
+    m_SlotMap[0] = 0x01;
+    m_LocStorage.SlotMapSet(m_SlotMap, 0, sizeof(m_SlotMap));
+
+    m_LocIndex[0].Addres = m_LocLibData->Addres;
+    m_LocIndex[0].Slot   = 0;
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::LocDataRead(LocLibData* DataPtr, uint16_t Slot)
+{
+#if LOCLIB_RESIDENT == 1
+    LocStorage::RecordDecode(m_Records[Slot], DataPtr);
+#else
+    m_LocStorage.LocDataGet(DataPtr, Slot);
+#endif
+}
+
+/***********************************************************************************************************************
+ */
+bool LocLib::LocDataWrite(LocLibData* DataPtr, uint16_t Slot)
+{
+    bool Result;
+
+    Result = m_LocStorage.LocDataSet(DataPtr, Slot);
+
+#if LOCLIB_RESIDENT == 1
+    if (Result == true)
+    {
+        LocStorage::RecordEncode(DataPtr, m_Records[Slot]);
+    }
+    else
+    {
+        /* Keep the record as stored, without the functions above F31. */
+        m_LocStorage.RecordRead(m_Records[Slot], Slot);
+    }
+#endif
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ * Each occupied record is read once with its own read. A sequential read over all slots would also transfer the
+ * unused bytes between the records, on the AT24C256 this costs more than the extra address phases.
+ */
+void LocLib::ResidentLoad(void)
+{
+#if LOCLIB_RESIDENT == 1
+    uint16_t Slot;
+
+    for (Slot = 0; Slot < MaxNumberOfLocs; Slot++)
+    {
+        if (SlotUsed(Slot) == true)
+        {
+            m_LocStorage.RecordRead(m_Records[Slot], Slot);
+        }
+    }
+#endif
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::LocIndexBuild(void)
+{
+    uint16_t Slot;
+    LocLibData Data;
+
+    /* Read each loc once and insert it, the index grows with the number of locs. */
+    m_NumberOfLocs = 0;
+    for (Slot = 0; Slot < MaxNumberOfLocs; Slot++)
+    {
+        if (SlotUsed(Slot) == true)
+        {
+            LocDataRead(&Data, Slot);
+            LocIndexInsert(Data.Addres, Slot);
+            m_NumberOfLocs++;
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+uint16_t LocLib::LocIndexSearch(uint16_t address, bool* Found)
+{
+    uint16_t Low  = 0;
+    uint16_t High = m_NumberOfLocs;
+    uint16_t Mid;
+
+    *Found = false;
+
+    while (Low < High)
+    {
+        Mid = Low + ((High - Low) / 2);
+
+        if (m_LocIndex[Mid].Addres < address)
+        {
+            Low = Mid + 1;
+        }
+        else
+        {
+            High = Mid;
+        }
+    }
+
+    if ((Low < m_NumberOfLocs) && (m_LocIndex[Low].Addres == address))
+    {
+        *Found = true;
+    }
+
+    return (Low);
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::LocIndexInsert(uint16_t address, uint16_t Slot)
+{
+    bool Found;
+    uint16_t Position;
+
+    Position = LocIndexSearch(address, &Found);
+
+    /* Make room for the new entry, the number of locs is increased by the caller. */
+    memmove(&m_LocIndex[Position + 1], &m_LocIndex[Position], (m_NumberOfLocs - Position) * sizeof(LocIndexEntry));
+    m_LocIndex[Position].Addres = address;
+    m_LocIndex[Position].Slot   = Slot;
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::LocIndexRemove(uint16_t Slot)
+{
+    uint16_t Index;
+    uint16_t Position = 0;
+
+    for (Index = 0; Index < m_NumberOfLocs; Index++)
+    {
+        if (m_LocIndex[Index].Slot != Slot)
+        {
+            m_LocIndex[Position] = m_LocIndex[Index];
+            Position++;
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+bool LocLib::SlotUsed(uint16_t Slot) { return ((m_SlotMap[Slot / 8] & (1 << (Slot % 8))) != 0); }
+
+/***********************************************************************************************************************
+ */
+void LocLib::SlotUsedSet(uint16_t Slot, bool Used)
+{
+    if (Used == true)
+    {
+        m_SlotMap[Slot / 8] |= (1 << (Slot % 8));
+    }
+    else
+    {
+        m_SlotMap[Slot / 8] &= ~(1 << (Slot % 8));
+    }
+
+    /* Only the changed byte of the slot map is written. */
+    m_LocStorage.SlotMapSet(m_SlotMap, Slot / 8, 1);
+}
+
+/***********************************************************************************************************************
+ */
+uint16_t LocLib::SlotFree(void)
+{
+    uint16_t Slot = MaxNumberOfLocs;
+
+    /* Prefer the slot after the last occupied slot so new locs are added at the end of the list. */
+    while ((Slot > 0) && (SlotUsed(Slot - 1) == false))
+    {
+        Slot--;
+    }
+
+    if (Slot >= MaxNumberOfLocs)
+    {
+        Slot = 0;
+        while ((Slot < MaxNumberOfLocs) && (SlotUsed(Slot) == true))
+        {
+            Slot++;
+        }
+    }
+
+    return (Slot);
+}
+
+/***********************************************************************************************************************
+ */
+uint16_t LocLib::SlotByPosition(uint16_t Position)
+{
+    uint16_t Byte;
+    uint8_t Count;
+    uint8_t Bit;
+    uint16_t Result = LocNotFound;
+
+    if (m_SortedInsert == true)
+    {
+        /* A sorted list is in index order. */
+        if (Position < m_NumberOfLocs)
+        {
+            Result = m_LocIndex[Position].Slot;
+        }
+    }
+    else
+    {
+        /* Skip whole bytes of the slot map, only the byte containing the slot is searched bit by bit. */
+        for (Byte = 0; Byte < sizeof(m_SlotMap); Byte++)
+        {
+            Count = slot_map_count(m_SlotMap[Byte]);
+            if (Position < Count)
+            {
+                for (Bit = 0; Bit < 8; Bit++)
+                {
+                    if ((m_SlotMap[Byte] & (1 << Bit)) != 0)
+                    {
+                        if (Position == 0)
+                        {
+                            Result = (Byte * 8) + Bit;
+                            break;
+                        }
+                        Position--;
+                    }
+                }
+                break;
+            }
+            Position -= Count;
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+uint16_t LocLib::PositionBySlot(uint16_t Slot)
+{
+    uint16_t Byte;
+    uint16_t Low;
+    uint16_t High;
+    uint16_t Mid;
+    uint16_t Position = 0;
+
+    if (m_SortedInsert == true)
+    {
+        /* The slots in the index of a sorted list are ascending, binary search of the slot. */
+        Low  = 0;
+        High = m_NumberOfLocs;
+        while (Low < High)
+        {
+            Mid = Low + ((High - Low) / 2);
+            if (m_LocIndex[Mid].Slot < Slot)
+            {
+                Low = Mid + 1;
+            }
+            else
+            {
+                High = Mid;
+            }
+        }
+        Position = Low;
+    }
+    else
+    {
+        for (Byte = 0; Byte < (Slot / 8); Byte++)
+        {
+            Position += slot_map_count(m_SlotMap[Byte]);
+        }
+        if ((Slot % 8) != 0)
+        {
+            Position += slot_map_count(m_SlotMap[Slot / 8] & ((1 << (Slot % 8)) - 1));
+        }
+    }
+
+    return (Position);
+}
+
+/***********************************************************************************************************************
+ */
+uint16_t LocLib::SlotSorted(uint16_t address)
+{
+    uint16_t Sources[MaxNumberOfLocs];
+    bool Found;
+    uint16_t Position;
+    uint16_t Index;
+    uint16_t Low;
+    uint16_t High;
+    uint16_t Up;
+    uint16_t Down;
+    uint16_t Slot;
+    uint16_t Selected = m_ActualSelectedLoc;
+
+    /* Free slots between the slots of the neighbours in the sorted list. */
+    Position = LocIndexSearch(address, &Found);
+    Low      = (Position > 0) ? (m_LocIndex[Position - 1].Slot + 1) : 0;
+    High     = (Position < m_NumberOfLocs) ? m_LocIndex[Position].Slot : MaxNumberOfLocs;
+
+    if (Low < High)
+    {
+        /* Added at the end or begin the slot next to the neighbour is used, so locs added in order stay adjacent. In
+         * between the middle slot leaves room on both sides. */
+        if (Position == m_NumberOfLocs)
+        {
+            Slot = Low;
+        }
+        else if (Position == 0)
+        {
+            Slot = High - 1;
+        }
+        else
+        {
+            Slot = Low + ((High - Low) / 2);
+        }
+    }
+    else
+    {
+        /* No free slot in between, search the nearest free slot above and below. At least one slot is free. */
+        Up = High;
+        while ((Up < MaxNumberOfLocs) && (SlotUsed(Up) == true))
+        {
+            Up++;
+        }
+        Down = Low;
+        while ((Down > 0) && (SlotUsed(Down - 1) == true))
+        {
+            Down--;
+        }
+
+        for (Index = 0; Index < MaxNumberOfLocs; Index++)
+        {
+            Sources[Index] = (SlotUsed(Index) == true) ? Index : LocNotFound;
+        }
+
+        if ((Down == 0) || ((Up < MaxNumberOfLocs) && ((Up - High) <= (Low - Down))))
+        {
+            /* Move the locs from the upper neighbour up to the free slot one slot up. */
+            for (Index = Up; Index > High; Index--)
+            {
+                Sources[Index] = Index - 1;
+            }
+            Sources[High] = LocNotFound;
+            Slot          = High;
+
+            for (Index = Position; (Index < m_NumberOfLocs) && (m_LocIndex[Index].Slot < Up); Index++)
+            {
+                m_LocIndex[Index].Slot++;
+            }
+        }
+        else
+        {
+            /* Move the locs from the free slot up to the lower neighbour one slot down. */
+            for (Index = Down - 1; Index < (Low - 1); Index++)
+            {
+                Sources[Index] = Index + 1;
+            }
+            Sources[Low - 1] = LocNotFound;
+            Slot             = Low - 1;
+
+            for (Index = Position; (Index > 0) && (m_LocIndex[Index - 1].Slot >= Down); Index--)
+            {
+                m_LocIndex[Index - 1].Slot--;
+            }
+        }
+
+        /* On ESP8266 the moved locs are committed at once, see LocSlotsMove() for AT24C256. */
+        m_LocStorage.TransactionBegin();
+        ActiveLocSlotsRemap(Sources);
+        LocSlotsMove(Sources);
+        m_LocStorage.TransactionEnd();
+
+        if (m_ActualSelectedLoc != Selected)
+        {
+            m_LocStorage.SelectedLocIndexStore(m_ActualSelectedLoc);
+        }
+    }
+
+    return (Slot);
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::LocSortedRestore(void)
+{
+    uint16_t Sources[MaxNumberOfLocs];
+    uint16_t Index;
+    uint16_t Target;
+    uint16_t Selected = m_ActualSelectedLoc;
+
+    for (Index = 1; Index < m_NumberOfLocs; Index++)
+    {
+        if (m_LocIndex[Index - 1].Slot > m_LocIndex[Index].Slot)
+        {
+            break;
+        }
+    }
+
+    if (Index < m_NumberOfLocs)
+    {
+        /* Entry n of the address index is moved to the n-th part of the slots. */
+        for (Index = 0; Index < MaxNumberOfLocs; Index++)
+        {
+            Sources[Index] = LocNotFound;
+        }
+        for (Index = 0; Index < m_NumberOfLocs; Index++)
+        {
+            Target                 = (uint16_t)(((uint32_t)Index * MaxNumberOfLocs) / m_NumberOfLocs);
+            Sources[Target]        = m_LocIndex[Index].Slot;
+            m_LocIndex[Index].Slot = Target;
+        }
+
+        /* On ESP8266 the moved locs are committed at once, see LocSlotsMove() for AT24C256. */
+        m_LocStorage.TransactionBegin();
+        ActiveLocSlotsRemap(Sources);
+        LocSlotsMove(Sources);
+        m_LocStorage.TransactionEnd();
+
+        if (m_ActualSelectedLoc != Selected)
+        {
+            m_LocStorage.SelectedLocIndexStore(m_ActualSelectedLoc);
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::LocSlotsMove(uint16_t* Sources)
+{
+    uint8_t MapOld[sizeof(m_SlotMap)];
+    uint16_t Start;
+    uint16_t Target;
+    uint16_t Source;
+    uint16_t First = sizeof(m_SlotMap);
+    uint16_t Last  = 0;
+    uint16_t Index;
+    LocLibData DataStart;
+    LocLibData Data;
+
+    memcpy(MapOld, m_SlotMap, sizeof(m_SlotMap));
+
+    /* The functions above F31 are kept per loc address, a moved loc reuses its own entry so LocDataWrite() does not
+     * fail here. */
+
+    /* Chains starting on a free slot. Moving a loc into the free slot frees its source slot, which is the target of
+     * the next loc in the chain. */
+    for (Start = 0; Start < MaxNumberOfLocs; Start++)
+    {
+        Target = Start;
+        while ((Sources[Target] != LocNotFound) && (SlotUsed(Target) == false))
+        {
+            Source = Sources[Target];
+            LocDataRead(&Data, Source);
+            LocDataWrite(&Data, Target);
+
+            m_SlotMap[Target / 8] |= (1 << (Target % 8));
+            m_SlotMap[Source / 8] &= ~(1 << (Source % 8));
+            Sources[Target] = Target;
+            Target          = Source;
+        }
+    }
+
+    /* Remaining locs form cycles of occupied slots. Save the first loc of a cycle, move the other locs and write the
+     * saved loc to the last freed slot. Each loc is read and written once. */
+    for (Start = 0; Start < MaxNumberOfLocs; Start++)
+    {
+        if ((Sources[Start] != LocNotFound) && (Sources[Start] != Start))
+        {
+            LocDataRead(&DataStart, Start);
+
+            Target = Start;
+            Source = Sources[Target];
+            while (Source != Start)
+            {
+                LocDataRead(&Data, Source);
+                LocDataWrite(&Data, Target);
+                Sources[Target] = Target;
+
+                Target = Source;
+                Source = Sources[Target];
+            }
+
+            LocDataWrite(&DataStart, Target);
+            Sources[Target] = Target;
+        }
+    }
+
+    /* Store the changed part of the slot map. */
+    for (Index = 0; Index < sizeof(m_SlotMap); Index++)
+    {
+        if (MapOld[Index] != m_SlotMap[Index])
+        {
+            if (Index < First)
+            {
+                First = Index;
+            }
+            Last = Index;
+        }
+    }
+
+    if (First < sizeof(m_SlotMap))
+    {
+        m_LocStorage.SlotMapSet(m_SlotMap, First, (Last - First) + 1);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t LocLib::ActiveLocFind(uint16_t Slot)
+{
+    uint8_t Index;
+    uint8_t Active = 255;
+
+    for (Index = 0; Index < m_NumberOfActiveLocs; Index++)
+    {
+        if (m_ActiveSlots[Index] == Slot)
+        {
+            Active = Index;
+            break;
+        }
+    }
+
+    return (Active);
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::ActiveLocSelectSet(uint8_t ActiveIndex)
+{
+    m_ActiveLoc         = ActiveIndex;
+    m_LocLibData        = &m_ActiveLocs[ActiveIndex];
+    m_ActualSelectedLoc = m_ActiveSlots[ActiveIndex];
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::ActiveLocLoad(uint16_t Slot)
+{
+    uint8_t Active = ActiveLocFind(Slot);
+
+    if (Active == 255)
+    {
+        /* The selected loc leaves the active locs, the new loc takes its entry. */
+        LocDataRead(m_LocLibData, Slot);
+        m_ActiveSlots[m_ActiveLoc] = Slot;
+        m_ActualSelectedLoc        = Slot;
+        ActiveLocStart(m_ActiveLoc);
+    }
+    else
+    {
+        /* Already active, keep the live state. */
+        ActiveLocSelectSet(Active);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::ActiveLocDrop(uint8_t ActiveIndex)
+{
+    uint8_t Index;
+
+    for (Index = ActiveIndex; Index < (m_NumberOfActiveLocs - 1); Index++)
+    {
+        memcpy(&m_ActiveLocs[Index], &m_ActiveLocs[Index + 1], sizeof(LocLibData));
+        m_ActiveSlots[Index]   = m_ActiveSlots[Index + 1];
+        m_ActiveRamps[Index]   = m_ActiveRamps[Index + 1];
+        m_ActiveChanges[Index] = m_ActiveChanges[Index + 1];
+    }
+    m_NumberOfActiveLocs--;
+
+    if (m_ActiveLoc > ActiveIndex)
+    {
+        m_ActiveLoc--;
+    }
+    ActiveLocSelectSet(m_ActiveLoc);
+}
+
+/***********************************************************************************************************************
+ */
+void LocLib::ActiveLocSlotsRemap(const uint16_t* Sources)
+{
+    uint8_t Active;
+    uint16_t Index;
+
+    for (Active = 0; Active < m_NumberOfActiveLocs; Active++)
+    {
+        for (Index = 0; Index < MaxNumberOfLocs; Index++)
+        {
+            if (Sources[Index] == m_ActiveSlots[Active])
+            {
+                m_ActiveSlots[Active] = Index;
+                break;
+            }
+        }
+    }
+
+    m_ActualSelectedLoc = m_ActiveSlots[m_ActiveLoc];
 }
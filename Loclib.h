@@ -12,6 +12,27 @@
 #include "LoclibData.h"
 #include <Arduino.h>
 
+#ifndef LOCLIB_MAX_NUMBER_OF_LOCS
+#define LOCLIB_MAX_NUMBER_OF_LOCS 64 /* Max number of locs, at most LocStorage::SlotsMax. */
+#endif
+
+#ifndef LOCLIB_RESIDENT
+#define LOCLIB_RESIDENT 0 /* 1: Init() loads all locs in RAM, loc data is only read from RAM. */
+#endif
+
+#ifndef LOCLIB_SORTED_INSERT
+#define LOCLIB_SORTED_INSERT 0 /* 1: Locs are kept sorted on address, new locs are stored at their sorted position. */
+#endif
+
+/**
+ * Walk over the stored locs in list order, see LocLib::LocCursorStart().
+ */
+struct LocLibCursor
+{
+    uint16_t Position; /* Position in the list of the next loc. */
+    uint16_t Slot;     /* Slot from which the next loc is searched, unsorted list. */
+};
+
 class LocLib
 {
 public:
@@ -35,6 +56,69 @@ public:
         storeChange,
     };
 
+    /**
+     * Protocol of the instructions created by the encoder.
+     */
+    enum protocol
+    {
+        protocolXpressNet = 0, /* XpressNet request including header and XOR byte. */
+        protocolDcc            /* DCC packet: address, instruction and error byte, without preamble and start bits. */
+    };
+
+    /**
+     * Changes of an active loc, reported by ConsumeChanges().
+     */
+    enum change
+    {
+        changeSpeed           = 0x0001,
+        changeDirection       = 0x0002,
+        changeSteps           = 0x0004,
+        changeFunctionGroup1  = 0x0008, /* F0 - F4, the next groups use the next bits. */
+        changeFunctionGroup2  = 0x0010,
+        changeFunctionGroup3  = 0x0020,
+        changeFunctionGroup4  = 0x0040,
+        changeFunctionGroup5  = 0x0080,
+        changeFunctionGroup6  = 0x0100,
+        changeFunctionGroup7  = 0x0200,
+        changeFunctionGroup8  = 0x0400,
+        changeFunctionGroup9  = 0x0800,
+        changeFunctionGroup10 = 0x1000
+    };
+
+    /**
+     * Function groups, each group is sent with its own instruction.
+     */
+    enum functionGroup
+    {
+        functionGroup1 = 0, /* F0 - F4 */
+        functionGroup2,     /* F5 - F8 */
+        functionGroup3,     /* F9 - F12 */
+        functionGroup4,     /* F13 - F20 */
+        functionGroup5,     /* F21 - F28 */
+        functionGroup6,     /* F29 - F36 */
+        functionGroup7,     /* F37 - F44 */
+        functionGroup8,     /* F45 - F52 */
+        functionGroup9,     /* F53 - F60 */
+        functionGroup10     /* F61 - F68 */
+    };
+
+    static const uint16_t MaxNumberOfLocs   = LOCLIB_MAX_NUMBER_OF_LOCS; /* Max number of locs. */
+    static const uint8_t MaxActiveLocs      = 3;                         /* Max number of locs controlled at once. */
+    static const uint16_t LocNotFound       = 0xFFFF;                    /* Index of a loc which is not stored. */
+    static const uint8_t InstructionSizeMax = 6;                         /* Max length of an encoded instruction. */
+    static const uint8_t NameLengthMax      = LOC_LIB_NAME_LENGTH;       /* Max number of characters of a name. */
+    static const uint8_t FunctionButtons    = LOC_LIB_FUNCTION_BUTTONS;  /* Function buttons of a loc. */
+
+    /**
+     * Receives the next bytes of an export, returns false to abort the export.
+     */
+    typedef bool (*ExportSink)(const uint8_t* Data, uint16_t Length, void* Context);
+
+    /**
+     * Delivers the next bytes of an import, returns the number of bytes delivered. Less than Length ends the import.
+     */
+    typedef uint16_t (*ImportSource)(uint8_t* Data, uint16_t Length, void* Context);
+
     /* Constructor. */
     LocLib();
 
@@ -45,7 +129,7 @@ public:
     void Init(LocStorage Storage);
 
     /**
-     * Get pointer to data of selected loc.
+     * Get pointer to data of selected loc. The pointer changes when another active loc is selected.
      */
     LocLibData* DataGet();
 
@@ -55,10 +139,18 @@ public:
     void UpdateLocData(uint16_t address);
 
     /**
-     * Increase, decrease, stop or reverse direction of selected loc.
+     * Increase, decrease, stop or reverse direction of selected loc. Returns the speed to send or 0xFFFF. With
+     * momentum the target speed is changed, the speed is ramped by Tick().
      */
     uint16_t SpeedSet(int8_t Delta);
 
+    /**
+     * Change the speed of the selected loc by a number of encoder steps in the direction of Delta, with the same
+     * result as Steps calls of SpeedSet(Delta) each followed by SpeedUpdate() of the returned speed. Returns the
+     * speed to send or 0xFFFF, the stored speed is not changed.
+     */
+    uint16_t SpeedSet(int8_t Delta, uint8_t Steps);
+
     /**
      * Get actual speed of selected loc.
      */
@@ -69,6 +161,36 @@ public:
      */
     void SpeedUpdate(uint8_t Speed);
 
+    /**
+     * Set the momentum of the selected loc, the time in ms to accelerate from stop to the highest speed step and to
+     * decelerate from the highest speed step to stop. 0 for both disables momentum. Locs added to the active locs
+     * get the momentum of the selected loc.
+     */
+    void RampSet(uint16_t Acceleration, uint16_t Deceleration);
+
+    /**
+     * Get the speed the selected loc is ramping to.
+     */
+    uint16_t RampTargetGet(void);
+
+    /**
+     * Ramp the speed of the active locs to their target speed, call periodic with the actual time in ms. Returns a
+     * bit for each active index of which the speed changed and must be sent.
+     */
+    uint8_t Tick(uint32_t Now);
+
+    /**
+     * Get and clear the changes of the selected loc since the last call, a combination of change bits. Only changes
+     * made by LocLib calls are tracked: speed by SpeedUpdate(), Tick() and stop, direction, decoder steps and
+     * functions. The speed returned by SpeedSet() is a speed to send, not a change of the stored speed.
+     */
+    uint16_t ConsumeChanges(void);
+
+    /**
+     * Get and clear the changes of an active loc, for example the speed changes of Tick().
+     */
+    uint16_t ConsumeChanges(uint8_t ActiveIndex);
+
     /**
      * Update decoder type of selected loc.
      */
@@ -95,30 +217,47 @@ public:
     void DirectionSet(direction dir);
 
     /**
-     * Write direct function data for selected loc.
+     * Write direct function data for selected loc, F0 up to F31. The higher functions are not changed.
      */
     void FunctionUpdate(uint32_t FunctionData);
 
     /**
-     * Toggle selected function of selected loc.
+     * Write direct function data for selected loc, all functions.
+     */
+    void FunctionsUpdate(const LocLibFunctions* Functions);
+
+    /**
+     * Toggle selected function of selected loc, F0 up to F68.
      */
     void FunctionToggle(uint8_t number);
 
     /**
-     * Get the assigned function to a button.
+     * Get the assigned function to a button, 255 for a button above FunctionButtons.
      */
     uint8_t FunctionAssignedGet(uint8_t number);
 
     /**
-     * Get the assigned functions of a loc in EEPROM.
+     * Get the assigned functions of a loc in EEPROM, functions must hold FunctionButtons bytes.
      */
     bool FunctionAssignedGetStored(uint16_t address, uint8_t* functions);
 
     /**
-     * Get the status of a function.
+     * Get the status of a function, functionNone above F68.
      */
     function FunctionStatusGet(uint32_t number);
 
+    /**
+     * Encode the speed and direction of the selected loc for its decoder steps. Returns the number of bytes written
+     * to Data, at most InstructionSizeMax.
+     */
+    uint8_t SpeedInstructionGet(protocol Protocol, uint8_t* Data);
+
+    /**
+     * Encode a function group of the selected loc. Returns the number of bytes written to Data, at most
+     * InstructionSizeMax.
+     */
+    uint8_t FunctionInstructionGet(protocol Protocol, functionGroup Group, uint8_t* Data);
+
     /**
      * Get the next or previous loc from stored in EEPROM.
      */
@@ -135,12 +274,14 @@ public:
     char* GetLocName(void);
 
     /**
-     * Check if loc is present in EEPROM.
+     * Check if loc is present in EEPROM. Returns the index of the loc in EEPROM or LocNotFound.
      */
-    uint8_t CheckLoc(uint16_t address);
+    uint16_t CheckLoc(uint16_t address);
 
     /**
-     * Store locomotive in EEPROM.
+     * Store locomotive in EEPROM. FunctionAssignment holds FunctionButtons functions, Name is cut to NameLengthMax
+     * characters. Returns false when the loc is not stored, or on storeChange when the functions above F31 of the loc
+     * did not fit in the table of LocStorage and were stored as off.
      */
     bool StoreLoc(uint16_t address, uint8_t* FunctionAssignment, char* Name, store storeAction);
 
@@ -154,6 +295,19 @@ public:
      */
     void RemoveAllLocs(void);
 
+    /**
+     * Stream the options and all stored locs in list order as checksummed image to the sink.
+     */
+    bool Export(ExportSink Sink, void* Context);
+
+    /**
+     * Replace the options and all stored locs by an image created by Export(). The locs are written without
+     * intermediate commits, the slot map once. Returns false when the image is invalid or the functions above F31 of
+     * the imported locs do not fit in the table of LocStorage, in that case the locs in the overwritten slots are
+     * removed and the other stored locs remain.
+     */
+    bool Import(ImportSource Source, void* Context);
+
     /**
      * Get actual number of locs in EEPROM.
      */
@@ -162,17 +316,77 @@ public:
     /**
      * Get the index of the selected loc.
      */
-    uint8_t GetActualSelectedLocIndex(void);
+    uint16_t GetActualSelectedLocIndex(void);
 
     /**
-     * Sort loc data in EEPROM.
+     * Sort loc data in EEPROM on address. Each loc not on its sorted position is read and written once.
      */
     void LocBubbleSort(void);
 
+    /**
+     * Enable or disable sorted insertion. While enabled the list is always sorted on address: an unsorted list is
+     * sorted once and new locs are stored at their sorted position, so LocBubbleSort() is not required.
+     */
+    void SortedInsertSet(bool Enable);
+
+    /**
+     * Check if sorted insertion is enabled.
+     */
+    bool SortedInsertGet(void);
+
+    /**
+     * Move the locs to the lowest slots in EEPROM, so no free slots remain between them. The order of the locs is
+     * not changed.
+     */
+    void LocCompact(void);
+
     /**
      * Read locdata direct based on index.
      */
-    LocLibData* LocGetAllDataByIndex(uint8_t Index);
+    LocLibData* LocGetAllDataByIndex(uint16_t Index);
+
+    /**
+     * Start a walk over the stored locs in list order at the given position. The walk does not change the selected
+     * or active locs and does not use the loc record cache. Storing, removing or moving locs ends the walk.
+     */
+    void LocCursorStart(LocLibCursor* Cursor, uint16_t Position);
+
+    /**
+     * Read the data of the next loc of a walk in the given buffer. Returns false at the end of the list.
+     */
+    bool LocCursorNext(LocLibCursor* Cursor, LocLibData* DataPtr);
+
+    /**
+     * Add a stored loc to the active locs and select it, the data of the loc is read from EEPROM. An already active
+     * loc is only selected. Returns the active index or 255 when the loc is not stored or no entry is free.
+     */
+    uint8_t ActiveLocAdd(uint16_t address);
+
+    /**
+     * Remove a loc from the active locs. When the selected loc is removed the first remaining active loc is
+     * selected, the last active loc can not be removed.
+     */
+    bool ActiveLocRemove(uint8_t ActiveIndex);
+
+    /**
+     * Select an active loc, without EEPROM access. Speed, direction and function changes apply to the selected loc.
+     */
+    bool ActiveLocSelect(uint8_t ActiveIndex);
+
+    /**
+     * Get the active index of the selected loc.
+     */
+    uint8_t ActiveLocSelectedGet(void);
+
+    /**
+     * Get the number of active locs.
+     */
+    uint8_t ActiveLocNumberGet(void);
+
+    /**
+     * Get the data of an active loc, NULL when the index is not in use.
+     */
+    LocLibData* ActiveLocDataGet(uint8_t ActiveIndex);
 
     /**
      * Set default loc data (1 loc with address 3) in EEPROM.
@@ -185,30 +399,186 @@ public:
     uint16_t limitLocAddress(uint16_t locAddress);
 
 private:
+    /**
+     * Single step of SpeedSet() starting from the given actual speed.
+     */
+    uint16_t SpeedStep(int8_t Delta, uint16_t Actual);
+
     /**
      * Increase the speed.
      */
-    uint16_t SpeedIncrease(void);
+    uint16_t SpeedIncrease(uint16_t Speed);
 
     /**
      * Decrease the speed.
      */
-    uint16_t SpeedDecrease(void);
+    uint16_t SpeedDecrease(uint16_t Speed);
 
     /**
      * Set speed to zero or change direction when speed already 0.
      */
     uint16_t SpeedStopOrChangeDirection(void);
 
-    LocLibData m_LocLibData; /* Data of actual selected loc. */
+    /**
+     * Change the target speed of the selected loc with momentum.
+     */
+    uint16_t SpeedTargetSet(int8_t Delta);
+
+    /**
+     * Start a loaded active loc without ramp and without changes, the target speed is the actual speed.
+     */
+    void ActiveLocStart(uint8_t ActiveIndex);
+
+    /**
+     * Read the data of the loc in the given slot, in resident mode from RAM.
+     */
+    void LocDataRead(LocLibData* DataPtr, uint16_t Slot);
+
+    /**
+     * Write the data of the loc in the given slot to EEPROM, in resident mode also to RAM. Returns false when the
+     * functions above F31 did not fit, the loc is then stored without them.
+     */
+    bool LocDataWrite(LocLibData* DataPtr, uint16_t Slot);
+
+    /**
+     * Load the records of all occupied slots in RAM (resident mode).
+     */
+    void ResidentLoad(void);
+
+    /**
+     * Rebuild the address index from the locs in EEPROM.
+     */
+    void LocIndexBuild(void);
+
+    /**
+     * Binary search of address in the index, returns the index position or the insert position when not found.
+     */
+    uint16_t LocIndexSearch(uint16_t address, bool* Found);
+
+    /**
+     * Add a loc to the address index.
+     */
+    void LocIndexInsert(uint16_t address, uint16_t Slot);
+
+    /**
+     * Remove the loc stored in the given slot from the address index.
+     */
+    void LocIndexRemove(uint16_t Slot);
+
+    /**
+     * Check if a slot in EEPROM contains a loc.
+     */
+    bool SlotUsed(uint16_t Slot);
+
+    /**
+     * Mark a slot in EEPROM as occupied or free.
+     */
+    void SlotUsedSet(uint16_t Slot, bool Used);
+
+    /**
+     * Get a free slot for a new loc.
+     */
+    uint16_t SlotFree(void);
+
+    /**
+     * Get the slot of the n-th loc in the list, occupied slots in ascending order. Returns LocNotFound when the list
+     * is shorter.
+     */
+    uint16_t SlotByPosition(uint16_t Position);
+
+    /**
+     * Get the position in the list of the loc in the given slot.
+     */
+    uint16_t PositionBySlot(uint16_t Slot);
+
+    /**
+     * Get a free slot for a new loc at its sorted position in the list. When the neighbours occupy adjacent slots
+     * the locs up to the nearest free slot are moved by one slot.
+     */
+    uint16_t SlotSorted(uint16_t address);
+
+    /**
+     * Sort the list when it is not sorted, the locs are spread evenly over the slots to leave room for insertions.
+     */
+    void LocSortedRestore(void);
+
+    /**
+     * Move locs in EEPROM so slot n contains the loc of slot Sources[n], LocNotFound for slots without loc afterwards.
+     * The locs are written first, the slot map last. Within a transaction the ESP8266 commits all of it at once. On
+     * AT24C256 the pages are written one by one, after a power loss while moving the old slot map may describe slots
+     * which are already overwritten: a loc can be lost and another loc can be stored twice.
+     */
+    void LocSlotsMove(uint16_t* Sources);
+
+    /**
+     * Get the active index of the loc stored in the given slot, 255 if not active.
+     */
+    uint8_t ActiveLocFind(uint16_t Slot);
+
+    /**
+     * Make the given active loc the selected loc.
+     */
+    void ActiveLocSelectSet(uint8_t ActiveIndex);
+
+    /**
+     * Make the loc stored in the given slot the selected loc. When not active it replaces the selected active loc.
+     */
+    void ActiveLocLoad(uint16_t Slot);
+
+    /**
+     * Remove an entry from the active locs, the selected loc must be another entry.
+     */
+    void ActiveLocDrop(uint8_t ActiveIndex);
+
+    /**
+     * Update the slots of the active locs for a move of slot Sources[n] to slot n.
+     */
+    void ActiveLocSlotsRemap(const uint16_t* Sources);
+
+    /**
+     * Momentum of an active loc.
+     */
+    struct LocRamp
+    {
+        uint16_t Acceleration; /* Time in ms from stop to highest speed step, 0 is no momentum. */
+        uint16_t Deceleration; /* Time in ms from highest speed step to stop, 0 is no momentum. */
+        uint16_t Target;       /* Speed the loc is ramping to. */
+        uint32_t Rest;         /* Time of the next step already passed, in ms * speed steps. */
+        uint32_t Time;         /* Time of the last tick. */
+        bool Timed;            /* Time is set by a tick since the ramp started, the first tick counts 0 ms. */
+    };
+
+    /**
+     * Address to EEPROM slot index entry.
+     */
+    struct LocIndexEntry
+    {
+        uint16_t Addres; /* Address of loc. */
+        uint16_t Slot;   /* Index of loc in EEPROM. */
+    };
+
+    LocLibData m_ActiveLocs[MaxActiveLocs];  /* Data of active locs, the live state of the controlled locs. */
+    uint16_t m_ActiveSlots[MaxActiveLocs];   /* EEPROM slot of active locs. */
+    LocRamp m_ActiveRamps[MaxActiveLocs];    /* Momentum of active locs. */
+    uint16_t m_ActiveChanges[MaxActiveLocs]; /* Changes of active locs not yet consumed. */
+    uint8_t m_NumberOfActiveLocs;            /* Number of active locs. */
+    uint8_t m_ActiveLoc;                     /* Active index of actual selected loc. */
+    LocLibData* m_LocLibData;                /* Data of actual selected loc, entry of m_ActiveLocs. */
+    LocLibData m_LocLibDataRead;             /* Data returned by LocGetAllDataByIndex. */
     LocStorage m_LocStorage;
-    uint8_t m_NumberOfLocs;      /* Number of locs. */
-    bool m_AcOption;             /* Direction change only with direction button. */
-    uint8_t m_ActualSelectedLoc; /* Actual selected loc. */
+    uint16_t m_NumberOfLocs;      /* Number of locs. */
+    bool m_AcOption;              /* Direction change only with direction button. */
+    uint16_t m_ActualSelectedLoc; /* Actual selected loc. */
+    bool m_SortedInsert;          /* List kept sorted on address, index and slot order are equal. */
 
-    static const uint8_t MaxNumberOfLocs  = 64; /* Max number of locs. */
     static const uint16_t ADDRESS_LOC_MIN = 1;
     static const uint16_t ADDRESS_LOC_MAX = 9999;
+
+    LocIndexEntry m_LocIndex[MaxNumberOfLocs];    /* Locs in EEPROM sorted on address. */
+    uint8_t m_SlotMap[(MaxNumberOfLocs + 7) / 8]; /* Occupied slots in EEPROM. */
+#if LOCLIB_RESIDENT == 1
+    uint8_t m_Records[MaxNumberOfLocs][LOC_STORAGE_RECORD_SIZE_MAX]; /* Packed records of all slots. */
+#endif
 };
 
 #endif
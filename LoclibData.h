@@ -29,18 +29,140 @@ enum direction
     directionForward = 0,
     directionBackWard
 };
+
+/* Number of functions of a loc, F0 up to F68. */
+#define LOC_LIB_FUNCTIONS 69
+
+#ifndef LOC_LIB_NAME_LENGTH
+#define LOC_LIB_NAME_LENGTH 10 /* Max number of characters of a loc name. */
+#endif
+
+#ifndef LOC_LIB_FUNCTION_BUTTONS
+#define LOC_LIB_FUNCTION_BUTTONS 5 /* Number of function buttons of which a loc stores the assigned function. */
+#endif
+
+/**
+ * State of the functions of a loc, bit n of the array is function n.
+ */
+struct LocLibFunctions
+{
+    uint8_t Bits[(LOC_LIB_FUNCTIONS + 7) / 8];
+
+    /**
+     * Get the state of a function, functions above F68 are off.
+     */
+    bool Get(uint8_t Number) const
+    {
+        return ((Number < LOC_LIB_FUNCTIONS) && ((Bits[Number / 8] & (1 << (Number % 8))) != 0));
+    }
+
+    /**
+     * Switch a function on or off, functions above F68 are ignored.
+     */
+    void Set(uint8_t Number, bool On)
+    {
+        if (Number < LOC_LIB_FUNCTIONS)
+        {
+            if (On == true)
+            {
+                Bits[Number / 8] |= (uint8_t)(1 << (Number % 8));
+            }
+            else
+            {
+                Bits[Number / 8] &= (uint8_t)(~(1 << (Number % 8)));
+            }
+        }
+    }
+
+    /**
+     * Toggle a function, functions above F68 are ignored.
+     */
+    void Toggle(uint8_t Number)
+    {
+        if (Number < LOC_LIB_FUNCTIONS)
+        {
+            Bits[Number / 8] ^= (uint8_t)(1 << (Number % 8));
+        }
+    }
+
+    /**
+     * Get the state of the eight functions starting at First, bit 0 is function First.
+     */
+    uint8_t Group(uint8_t First) const
+    {
+        uint16_t Window = Bits[First / 8];
+
+        if ((First / 8) < (sizeof(Bits) - 1))
+        {
+            Window |= (uint16_t)(Bits[(First / 8) + 1]) << 8;
+        }
+
+        return ((uint8_t)(Window >> (First % 8)));
+    }
+
+    /**
+     * Get the state of F0 up to F31.
+     */
+    uint32_t Low(void) const
+    {
+        return ((uint32_t)(Bits[0]) | ((uint32_t)(Bits[1]) << 8) | ((uint32_t)(Bits[2]) << 16)
+            | ((uint32_t)(Bits[3]) << 24));
+    }
+
+    /**
+     * Set the state of F0 up to F31, the higher functions are not changed.
+     */
+    void LowSet(uint32_t Functions)
+    {
+        Bits[0] = (uint8_t)(Functions & 0xFF);
+        Bits[1] = (uint8_t)((Functions >> 8) & 0xFF);
+        Bits[2] = (uint8_t)((Functions >> 16) & 0xFF);
+        Bits[3] = (uint8_t)(Functions >> 24);
+    }
+
+    /**
+     * Compatibility with applications written for the 32 bit function word: read as F0 up to F31.
+     */
+    operator uint32_t() const { return (Low()); }
+
+    /**
+     * Compatibility with applications written for the 32 bit function word: set F0 up to F31, the higher functions
+     * are not changed.
+     */
+    LocLibFunctions& operator=(uint32_t Functions)
+    {
+        LowSet(Functions);
+        return (*this);
+    }
+};
+
 /**
  * Actual loc data of selected loc.
  */
 struct LocLibData
 {
-    uint16_t Addres;               /* Address of loc */
-    uint16_t Speed;                /* Actual speed of loc */
-    direction Dir;                 /* Direction of loc */
-    decoderSteps Steps;            /* Decoder steps of loc */
-    uint32_t Function;             /* Actual functions of loc. */
-    uint8_t FunctionAssignment[5]; /* Assigned functions to buttons of loc. */
-    char Name[11];                 /* Name of loc. */
+    uint16_t Addres;                                      /* Address of loc */
+    uint16_t Speed;                                       /* Actual speed of loc */
+    direction Dir;                                        /* Direction of loc */
+    decoderSteps Steps;                                   /* Decoder steps of loc */
+    LocLibFunctions Function;                             /* Actual functions of loc. */
+    uint8_t FunctionAssignment[LOC_LIB_FUNCTION_BUTTONS]; /* Assigned functions to buttons of loc. */
+    char Name[LOC_LIB_NAME_LENGTH + 1];                   /* Name of loc. */
+};
+
+/**
+ * Loc data as stored in raw records by versions before the packed records, only used to convert these records. The
+ * raw records always have 5 function buttons and names of 10 characters.
+ */
+struct LocLibDataLegacy
+{
+    uint16_t Addres;
+    uint16_t Speed;
+    direction Dir;
+    decoderSteps Steps;
+    uint32_t Function; /* F0 up to F31. */
+    uint8_t FunctionAssignment[5];
+    char Name[11];
 };
 
 #endif
@@ -0,0 +1,208 @@
+/***********************************************************************************************************************
+   @file   LoclibInput.cpp
+   @brief  Queue of encoder and button input from interrupts, handled by LocLib in the main loop.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "LoclibInput.h"
+#include <Arduino.h>
+
+/***********************************************************************************************************************
+   D E F I N E S
+ **********************************************************************************************************************/
+#define LOCLIB_INPUT_QUEUE_MASK (LOCLIB_INPUT_QUEUE_SIZE - 1)
+#define LOCLIB_INPUT_STEPS_MAX 255 /* Max steps of one eventSpeed, the rest is taken by the next EventGet(). */
+
+static_assert((LOCLIB_INPUT_QUEUE_SIZE & LOCLIB_INPUT_QUEUE_MASK) == 0, "Input queue size must be a power of 2.");
+static_assert(LOCLIB_INPUT_QUEUE_SIZE <= 128, "Input queue size must fit the 8 bit indices.");
+static_assert(LOCLIB_INPUT_BUTTON_RESERVE < LOCLIB_INPUT_QUEUE_SIZE, "Input queue needs an entry for encoder steps.");
+
+/***********************************************************************************************************************
+   F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+LocLibInput::LocLibInput()
+{
+    m_Head       = 0;
+    m_Tail       = 0;
+    m_RunsPushed = 0;
+    m_RunsTaken  = 0;
+    m_StepsTaken = 0;
+}
+
+/***********************************************************************************************************************
+ */
+bool LocLibInput::StepPush(int8_t Delta)
+{
+    uint8_t Head      = m_Head;
+    int8_t Direction  = (Delta > 0) ? 1 : -1;
+    uint8_t Steps     = (uint8_t)((Delta > 0) ? Delta : -Delta);
+    QueueEntry* Entry = &m_Queue[(uint8_t)(Head - 1) & LOCLIB_INPUT_QUEUE_MASK];
+    bool Result       = true;
+
+    if (Delta == 0)
+    {
+        /* Nothing to add. */
+    }
+    else if ((Head != m_Tail) && (Entry->Type == eventSpeed) && (Entry->Delta == Direction))
+    {
+        /* The consumer never passes the last entry while it is a run, so the run can still grow. */
+        Entry->Steps = (uint16_t)(Entry->Steps + Steps);
+    }
+    else if (((uint8_t)(m_RunsPushed - m_RunsTaken) < (LOCLIB_INPUT_QUEUE_SIZE - LOCLIB_INPUT_BUTTON_RESERVE))
+        && ((uint8_t)(Head - m_Tail) < LOCLIB_INPUT_QUEUE_SIZE))
+    {
+        Entry         = &m_Queue[Head & LOCLIB_INPUT_QUEUE_MASK];
+        Entry->Type   = (uint8_t)eventSpeed;
+        Entry->Number = 0;
+        Entry->Delta  = Direction;
+        Entry->Steps  = Steps;
+        m_RunsPushed++;
+
+        /* The entry must be complete before the consumer sees it. */
+        __sync_synchronize();
+        m_Head = (uint8_t)(Head + 1);
+    }
+    else
+    {
+        Result = false;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+bool LocLibInput::EventPush(event Type, uint8_t Number)
+{
+    uint8_t Head = m_Head;
+    bool Result  = false;
+
+    /* Runs of steps never use the reserved entries, so there is room unless the queue is full of button events. */
+    if ((uint8_t)(Head - m_Tail) < LOCLIB_INPUT_QUEUE_SIZE)
+    {
+        m_Queue[Head & LOCLIB_INPUT_QUEUE_MASK].Type   = (uint8_t)Type;
+        m_Queue[Head & LOCLIB_INPUT_QUEUE_MASK].Number = Number;
+        m_Queue[Head & LOCLIB_INPUT_QUEUE_MASK].Delta  = 0;
+        m_Queue[Head & LOCLIB_INPUT_QUEUE_MASK].Steps  = 0;
+
+        /* The entry must be complete before the consumer sees it. */
+        __sync_synchronize();
+        m_Head = (uint8_t)(Head + 1);
+        Result = true;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+bool LocLibInput::EventGet(LocLibInputEvent* EventPtr)
+{
+    uint8_t Head = m_Head;
+    uint8_t Tail = m_Tail;
+    bool Result  = false;
+    bool Done    = false;
+    QueueEntry* Entry;
+    uint16_t Pending;
+
+    /* The entries up to Head are complete, a run before Head is closed and its steps are final. */
+    __sync_synchronize();
+
+    while ((Done == false) && (Tail != Head))
+    {
+        Entry = &m_Queue[Tail & LOCLIB_INPUT_QUEUE_MASK];
+        if (Entry->Type == eventSpeed)
+        {
+            Pending = (uint16_t)(Entry->Steps - m_StepsTaken);
+            if (Pending != 0)
+            {
+                if (Pending > LOCLIB_INPUT_STEPS_MAX)
+                {
+                    Pending = LOCLIB_INPUT_STEPS_MAX;
+                }
+                EventPtr->Type   = eventSpeed;
+                EventPtr->Delta  = Entry->Delta;
+                EventPtr->Steps  = (uint8_t)Pending;
+                EventPtr->Number = 0;
+                m_StepsTaken     = (uint16_t)(m_StepsTaken + Pending);
+                Result           = true;
+                Done             = true;
+            }
+            else if ((uint8_t)(Tail + 1) != Head)
+            {
+                /* Run closed by a later entry and completely taken. */
+                __sync_synchronize();
+                Tail         = (uint8_t)(Tail + 1);
+                m_Tail       = Tail;
+                m_StepsTaken = 0;
+                m_RunsTaken  = (uint8_t)(m_RunsTaken + 1);
+            }
+            else
+            {
+                /* The last run is kept, steps pushed later are added to it. */
+                Done = true;
+            }
+        }
+        else
+        {
+            EventPtr->Type   = Entry->Type;
+            EventPtr->Delta  = 0;
+            EventPtr->Steps  = 0;
+            EventPtr->Number = Entry->Number;
+
+            /* The entry must be read before the producer may overwrite it. */
+            __sync_synchronize();
+            m_Tail = (uint8_t)(Tail + 1);
+            Result = true;
+            Done   = true;
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+void LocLibInput::Clear(void)
+{
+    uint8_t Head   = m_Head;
+    uint8_t Tail   = m_Tail;
+    uint8_t Runs   = 0;
+    bool Done      = false;
+    uint16_t Steps = m_StepsTaken;
+    QueueEntry* Entry;
+
+    /* Only the entries up to one snapshot of Head are removed, the runs are counted like EventGet() does. */
+    __sync_synchronize();
+
+    while ((Done == false) && (Tail != Head))
+    {
+        Entry = &m_Queue[Tail & LOCLIB_INPUT_QUEUE_MASK];
+        if ((Entry->Type == eventSpeed) && ((uint8_t)(Tail + 1) == Head))
+        {
+            /* The last run is kept with all its steps taken, steps pushed later are added to it. */
+            Steps = Entry->Steps;
+            Done  = true;
+        }
+        else
+        {
+            if (Entry->Type == eventSpeed)
+            {
+                Runs++;
+            }
+            Tail  = (uint8_t)(Tail + 1);
+            Steps = 0;
+        }
+    }
+
+    /* The entries must be read before the producer may overwrite them. */
+    __sync_synchronize();
+    m_Tail       = Tail;
+    m_StepsTaken = Steps;
+    m_RunsTaken  = (uint8_t)(m_RunsTaken + Runs);
+}
@@ -0,0 +1,105 @@
+/**
+ **********************************************************************************************************************
+ * @file  LoclibInput.h
+ * @brief Queue of encoder and button input from interrupts, handled by LocLib in the main loop.
+ ***********************************************************************************************************************
+ */
+
+#ifndef LOC_LIB_INPUT_H
+#define LOC_LIB_INPUT_H
+
+#include <Arduino.h>
+
+#ifndef LOCLIB_INPUT_QUEUE_SIZE
+#define LOCLIB_INPUT_QUEUE_SIZE 8 /* Number of events which can be queued, a power of 2. */
+#endif
+
+#ifndef LOCLIB_INPUT_BUTTON_RESERVE
+#define LOCLIB_INPUT_BUTTON_RESERVE (LOCLIB_INPUT_QUEUE_SIZE / 2) /* Queue entries never used by encoder steps. */
+#endif
+
+/**
+ * Input taken from the queue.
+ */
+struct LocLibInputEvent
+{
+    uint8_t Type;   /* LocLibInput::event. */
+    int8_t Delta;   /* eventSpeed: direction of the encoder steps, 1 or -1. */
+    uint8_t Steps;  /* eventSpeed: number of encoder steps. */
+    uint8_t Number; /* eventFunction: function, eventButton: button of the application. */
+};
+
+/**
+ * Single producer / single consumer queue without locks. Interrupts push encoder steps and button events, the main
+ * loop takes them in the order they were pushed. Encoder steps in the same direction without button event in between
+ * are added up and taken as one event, so a fast turn of the encoder results in a single LocLib::SpeedSet(Delta,
+ * Steps) call. A change of direction starts a new run of steps, steps in opposite directions are never netted.
+ *
+ * Runs of steps use at most LOCLIB_INPUT_QUEUE_SIZE - LOCLIB_INPUT_BUTTON_RESERVE entries, so encoder input never
+ * takes the room of button events. Steps are lost only when a change of direction finds no free entry for a run,
+ * button events only when the queue is full of button events.
+ *
+ * StepPush() and EventPush() must be called from interrupts which do not interrupt each other, EventGet() only from
+ * the main loop.
+ */
+class LocLibInput
+{
+public:
+    /**
+     * Type of input.
+     */
+    enum event
+    {
+        eventSpeed = 0, /* Encoder steps, for LocLib::SpeedSet(Delta, Steps). */
+        eventStop,      /* Stop, for LocLib::SpeedSet(0). */
+        eventDirection, /* Change direction, for LocLib::DirectionToggle(). */
+        eventFunction,  /* Toggle a function, for LocLib::FunctionToggle(). */
+        eventButton     /* Other button of the application. */
+    };
+
+    /* Constructor. */
+    LocLibInput();
+
+    /**
+     * Add encoder steps, positive or negative. Called from interrupt, returns false when the steps change the
+     * direction and no entry is free for a new run.
+     */
+    bool StepPush(int8_t Delta);
+
+    /**
+     * Add a button event, Number is the function or button. Called from interrupt, returns false when the queue is
+     * full.
+     */
+    bool EventPush(event Type, uint8_t Number);
+
+    /**
+     * Take the next input. Returns false when there is no input.
+     */
+    bool EventGet(LocLibInputEvent* EventPtr);
+
+    /**
+     * Remove all queued input. Called from the main loop like EventGet(), input pushed meanwhile may be kept.
+     */
+    void Clear(void);
+
+private:
+    /**
+     * Queued button event or run of encoder steps in one direction.
+     */
+    struct QueueEntry
+    {
+        uint8_t Type;            /* Type of the event. */
+        uint8_t Number;          /* Function or button. */
+        int8_t Delta;            /* eventSpeed: direction of the run, 1 or -1. */
+        volatile uint16_t Steps; /* eventSpeed: steps of the run, the last entry still grows. */
+    };
+
+    QueueEntry m_Queue[LOCLIB_INPUT_QUEUE_SIZE]; /* Button events and runs of steps. */
+    volatile uint8_t m_Head;                     /* Next entry to write, written by the producer only. */
+    volatile uint8_t m_Tail;                     /* Next entry to read, written by the consumer only. */
+    volatile uint8_t m_RunsPushed;               /* Number of pushed runs, written by the producer only. */
+    volatile uint8_t m_RunsTaken;                /* Number of taken runs, written by the consumer only. */
+    uint16_t m_StepsTaken;                       /* Taken steps of the run at the tail. */
+};
+
+#endif
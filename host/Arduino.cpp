@@ -0,0 +1,44 @@
+/***********************************************************************************************************************
+   @file   Arduino.cpp
+   @brief  Minimal Arduino environment for building LocLib on a host (Linux) system.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Arduino.h"
+#include <time.h>
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * Monotonic time in microseconds.
+ */
+static uint64_t host_time_us(void)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (((uint64_t)(Now.tv_sec) * 1000000ULL) + ((uint64_t)(Now.tv_nsec) / 1000ULL));
+}
+
+/***********************************************************************************************************************
+ */
+unsigned long millis(void) { return ((unsigned long)(host_time_us() / 1000ULL)); }
+
+/***********************************************************************************************************************
+ */
+unsigned long micros(void) { return ((unsigned long)(host_time_us())); }
+
+/***********************************************************************************************************************
+ */
+void delay(unsigned long ms)
+{
+    struct timespec Wait;
+
+    Wait.tv_sec  = ms / 1000;
+    Wait.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&Wait, NULL);
+}
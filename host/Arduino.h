@@ -0,0 +1,32 @@
+/**
+ **********************************************************************************************************************
+ * @file  Arduino.h
+ * @brief Minimal Arduino environment for building LocLib on a host (Linux) system.
+ ***********************************************************************************************************************
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+/**
+ * Milliseconds since start of the program.
+ */
+unsigned long millis(void);
+
+/**
+ * Microseconds since start of the program.
+ */
+unsigned long micros(void);
+
+/**
+ * Wait the given number of milliseconds.
+ */
+void delay(unsigned long ms);
+
+#endif
@@ -0,0 +1,20 @@
+/**
+ **********************************************************************************************************************
+ * @file  app_cfg.h
+ * @brief Application configuration for building LocLib on a host (Linux) system.
+ ***********************************************************************************************************************
+ */
+
+#ifndef APP_CFG_H
+#define APP_CFG_H
+
+#define APP_CFG_UC_ESP8266 1
+#define APP_CFG_UC_STM32 2
+#define APP_CFG_UC_HOST 3
+
+/* The benchmark builds select a target with emulated hardware on the command line. */
+#ifndef APP_CFG_UC
+#define APP_CFG_UC APP_CFG_UC_HOST
+#endif
+
+#endif
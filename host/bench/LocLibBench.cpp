@@ -0,0 +1,376 @@
+/***********************************************************************************************************************
+   @file   LocLibBench.cpp
+   @brief  Storage cost of the LocLib operations for table sizes 1..MaxNumberOfLocs on emulated hardware.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Loclib.h"
+#include "MockHw.h"
+#include "app_cfg.h"
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+
+/***********************************************************************************************************************
+   D E F I N E S
+ **********************************************************************************************************************/
+#define BENCH_ADDRESS_FIRST 9000 /* Address of first added loc, next locs get lower addresses. */
+#define BENCH_ADDRESS_NEW 9500   /* Address of a loc not in the table. */
+#define BENCH_IMAGE_SIZE (16 + (LOC_STORAGE_RECORD_SIZE_MAX * LocLib::MaxNumberOfLocs)) /* Export image of all locs. */
+
+#if APP_CFG_UC == APP_CFG_UC_ESP8266
+#define BENCH_TARGET "esp8266"
+#elif APP_CFG_UC == APP_CFG_UC_STM32
+#define BENCH_TARGET "stm32"
+#else
+#define BENCH_TARGET "host"
+#endif
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+enum BenchFormat
+{
+    benchFormatCsv = 0,
+    benchFormatJson
+};
+
+/**
+ * Operation under test, executed on a table with the given number of locs.
+ */
+struct BenchOperation
+{
+    const char* Name;
+    uint16_t LocsMin; /* Minimal table size for the operation. */
+    uint16_t LocsMax; /* Maximal table size for the operation. */
+    void (*Prepare)(LocLib* Lib, LocStorage* Storage, uint16_t Locs); /* Not measured, may be NULL. */
+    void (*Run)(LocLib* Lib, LocStorage* Storage, uint16_t Locs);
+};
+
+static BenchFormat Format                                  = benchFormatCsv;
+static bool FirstRecord                                    = true;
+static uint8_t FunctionAssignment[LocLib::FunctionButtons] = { 0 };
+static char Name[]                                         = "bench";
+static uint8_t Image[BENCH_IMAGE_SIZE];
+static uint16_t ImageLength;
+static uint16_t ImagePosition;
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * Address of the n-th added loc. Locs are added in descending address order so sorting has maximal work.
+ */
+static uint16_t bench_address(uint16_t n) { return ((uint16_t)(BENCH_ADDRESS_FIRST - n)); }
+
+/***********************************************************************************************************************
+ */
+static void bench_init(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    LocStorage StorageNew;
+    LocLib LibNew;
+
+    (void)(Lib);
+    (void)(Storage);
+    (void)(Locs);
+
+    StorageNew.Init();
+    LibNew.Init(StorageNew);
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_store_add(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    (void)(Locs);
+    Lib->StoreLoc(BENCH_ADDRESS_NEW, FunctionAssignment, Name, LocLib::storeAdd);
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_store_change(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    char NameChanged[] = "changed";
+
+    (void)(Storage);
+    Lib->StoreLoc(bench_address(Locs - 1), FunctionAssignment, NameChanged, LocLib::storeChange);
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_remove(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    (void)(Locs);
+    Lib->RemoveLoc(Lib->LocGetAllDataByIndex(0)->Addres);
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_check_hit(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    Lib->CheckLoc(bench_address(Locs - 1));
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_check_miss(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    (void)(Locs);
+    Lib->CheckLoc(BENCH_ADDRESS_NEW);
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_next(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    (void)(Locs);
+    Lib->GetNextLoc(1);
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_previous(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    (void)(Locs);
+    Lib->GetNextLoc(-1);
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_assigned(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    uint8_t Functions[LocLib::FunctionButtons];
+
+    (void)(Storage);
+    Lib->FunctionAssignedGetStored(bench_address(Locs - 1), Functions);
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_sort(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    (void)(Locs);
+    Lib->LocBubbleSort();
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_compact(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    (void)(Locs);
+    Lib->LocCompact();
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_update(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    Lib->UpdateLocData(bench_address(Locs - 1));
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_active_add(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    Lib->ActiveLocAdd(bench_address(Locs - 1));
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_active_select(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    (void)(Locs);
+    Lib->ActiveLocSelect(0);
+}
+
+/***********************************************************************************************************************
+ */
+static bool bench_image_write(const uint8_t* Data, uint16_t Length, void* Context)
+{
+    bool Result = false;
+
+    (void)(Context);
+    if ((ImageLength + Length) <= sizeof(Image))
+    {
+        memcpy(&Image[ImageLength], Data, Length);
+        ImageLength += Length;
+        Result = true;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+static uint16_t bench_image_read(uint8_t* Data, uint16_t Length, void* Context)
+{
+    (void)(Context);
+    if (Length > (ImageLength - ImagePosition))
+    {
+        Length = ImageLength - ImagePosition;
+    }
+    memcpy(Data, &Image[ImagePosition], Length);
+    ImagePosition += Length;
+
+    return (Length);
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_export(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    (void)(Locs);
+    ImageLength = 0;
+    Lib->Export(bench_image_write, NULL);
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_import(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    (void)(Storage);
+    (void)(Locs);
+    ImagePosition = 0;
+    Lib->Import(bench_image_read, NULL);
+}
+
+static const BenchOperation Operations[] = {
+    { "Init", 1, LocLib::MaxNumberOfLocs, NULL, bench_init },
+    { "StoreLoc.add", 1, LocLib::MaxNumberOfLocs - 1, NULL, bench_store_add },
+    { "StoreLoc.change", 1, LocLib::MaxNumberOfLocs, NULL, bench_store_change },
+    { "RemoveLoc", 2, LocLib::MaxNumberOfLocs, NULL, bench_remove },
+    { "CheckLoc.hit", 1, LocLib::MaxNumberOfLocs, NULL, bench_check_hit },
+    { "CheckLoc.miss", 1, LocLib::MaxNumberOfLocs, NULL, bench_check_miss },
+    { "GetNextLoc", 1, LocLib::MaxNumberOfLocs, NULL, bench_next },
+    { "GetNextLoc.back", 2, LocLib::MaxNumberOfLocs, bench_next, bench_previous },
+    { "FunctionAssignedGetStored", 1, LocLib::MaxNumberOfLocs, bench_assigned, bench_assigned },
+    { "LocBubbleSort", 1, LocLib::MaxNumberOfLocs, NULL, bench_sort },
+    { "LocCompact", 2, LocLib::MaxNumberOfLocs, bench_remove, bench_compact },
+    { "UpdateLocData", 1, LocLib::MaxNumberOfLocs, NULL, bench_update },
+    { "ActiveLocAdd", 2, LocLib::MaxNumberOfLocs, NULL, bench_active_add },
+    { "ActiveLocSelect", 2, LocLib::MaxNumberOfLocs, bench_active_add, bench_active_select },
+    { "Export", 1, LocLib::MaxNumberOfLocs, NULL, bench_export },
+    { "Import", 1, LocLib::MaxNumberOfLocs, bench_export, bench_import },
+};
+
+/***********************************************************************************************************************
+ * Fill an erased memory with the given number of locs. The first loc is the loc created by Init().
+ */
+static void bench_setup(LocLib* Lib, LocStorage* Storage, uint16_t Locs)
+{
+    uint16_t Index;
+
+    MockHwErase();
+    Storage->Init();
+    Lib->Init(*Storage);
+
+    /* Replace the initial loc so all addresses are in descending order. */
+    Lib->StoreLoc(bench_address(0), FunctionAssignment, Name, LocLib::storeAdd);
+    Lib->RemoveLoc(Lib->LocGetAllDataByIndex(0)->Addres);
+    Lib->LocCompact();
+    for (Index = 1; Index < Locs; Index++)
+    {
+        Lib->StoreLoc(bench_address(Index), FunctionAssignment, Name, LocLib::storeAddNoAutoSelect);
+    }
+    Lib->GetNextLoc(0);
+}
+
+/***********************************************************************************************************************
+ * Let pending writes complete, so the measurement starts with idle hardware.
+ */
+static void bench_settle(LocStorage* Storage)
+{
+    Storage->Flush();
+    delay(100);
+}
+
+/***********************************************************************************************************************
+ */
+static void bench_print(const char* Operation, uint16_t Locs, const MockHwStats* Stats)
+{
+    if (Format == benchFormatJson)
+    {
+        printf("%s\n  {\"target\": \"%s\", \"operation\": \"%s\", \"locs\": %u, \"i2c_transactions\": %lu, "
+               "\"i2c_bytes\": %lu, \"page_writes\": %lu, \"flash_commits\": %lu, \"flash_bytes\": %lu, "
+               "\"time_us\": %llu}",
+            (FirstRecord == true) ? "[" : ",", BENCH_TARGET, Operation, Locs, (unsigned long)(Stats->I2cTransactions),
+            (unsigned long)(Stats->I2cBytes), (unsigned long)(Stats->PageWrites), (unsigned long)(Stats->FlashCommits),
+            (unsigned long)(Stats->FlashBytes), (unsigned long long)(Stats->TimeUs));
+    }
+    else
+    {
+        if (FirstRecord == true)
+        {
+            printf("target,operation,locs,i2c_transactions,i2c_bytes,page_writes,flash_commits,flash_bytes,time_us\n");
+        }
+        printf("%s,%s,%u,%lu,%lu,%lu,%lu,%lu,%llu\n", BENCH_TARGET, Operation, Locs,
+            (unsigned long)(Stats->I2cTransactions), (unsigned long)(Stats->I2cBytes),
+            (unsigned long)(Stats->PageWrites), (unsigned long)(Stats->FlashCommits),
+            (unsigned long)(Stats->FlashBytes), (unsigned long long)(Stats->TimeUs));
+    }
+
+    FirstRecord = false;
+}
+
+/***********************************************************************************************************************
+ */
+int main(int argc, char** argv)
+{
+    LocStorage Storage;
+    LocLib Lib;
+    MockHwStats Stats;
+    uint8_t Operation;
+    uint16_t Locs;
+
+    if ((argc > 1) && (strcmp(argv[1], "--json") == 0))
+    {
+        Format = benchFormatJson;
+    }
+    else if (argc > 1)
+    {
+        fprintf(stderr, "usage: %s [--json]\n", argv[0]);
+        return (1);
+    }
+
+    for (Operation = 0; Operation < sizeof(Operations) / sizeof(Operations[0]); Operation++)
+    {
+        for (Locs = Operations[Operation].LocsMin; Locs <= Operations[Operation].LocsMax; Locs++)
+        {
+            bench_setup(&Lib, &Storage, Locs);
+            if (Operations[Operation].Prepare != NULL)
+            {
+                Operations[Operation].Prepare(&Lib, &Storage, Locs);
+            }
+            bench_settle(&Storage);
+
+            MockHwStatsReset();
+            Operations[Operation].Run(&Lib, &Storage, Locs);
+            Storage.Flush();
+            MockHwStatsGet(&Stats);
+
+            bench_print(Operations[Operation].Name, Locs, &Stats);
+        }
+    }
+
+    if (Format == benchFormatJson)
+    {
+        printf("\n]\n");
+    }
+
+    return (0);
+}
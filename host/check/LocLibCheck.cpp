@@ -0,0 +1,177 @@
+/***********************************************************************************************************************
+   @file   LocLibCheck.cpp
+   @brief  Check of the XpressNet / DCC instructions created by LocLib against known packets.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Loclib.h"
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+/**
+ * Expected speed instruction for a loc state.
+ */
+struct CheckSpeed
+{
+    uint16_t Address;
+    decoderSteps Steps;
+    direction Dir;
+    uint8_t Speed;
+    bool F0;
+    LocLib::protocol Protocol;
+    uint8_t Length;
+    uint8_t Data[LocLib::InstructionSizeMax];
+};
+
+/**
+ * Expected function instruction of a group.
+ */
+struct CheckFunction
+{
+    LocLib::functionGroup Group;
+    LocLib::protocol Protocol;
+    uint8_t Length;
+    uint8_t Data[LocLib::InstructionSizeMax];
+};
+
+/* Packets including the XpressNet XOR byte / the DCC error byte. The 28 step speed bits have the intermediate step
+ * in bit 4, in 14 step DCC packets bit 4 is FL (F0). Addresses above 99 are sent as long address. */
+static const CheckSpeed SpeedChecks[] = {
+    { 3, decoderStep14, directionForward, 14, false, LocLib::protocolXpressNet, 6, { 0xE4, 0x10, 0x00, 0x03, 0x8F, 0x78 } },
+    { 3, decoderStep14, directionForward, 5, true, LocLib::protocolDcc, 3, { 0x03, 0x76, 0x75 } },
+    { 3, decoderStep14, directionForward, 5, false, LocLib::protocolDcc, 3, { 0x03, 0x66, 0x65 } },
+    { 3, decoderStep28, directionForward, 1, false, LocLib::protocolXpressNet, 6, { 0xE4, 0x12, 0x00, 0x03, 0x82, 0x77 } },
+    { 3, decoderStep28, directionForward, 2, false, LocLib::protocolXpressNet, 6, { 0xE4, 0x12, 0x00, 0x03, 0x92, 0x67 } },
+    { 3, decoderStep28, directionForward, 2, true, LocLib::protocolDcc, 3, { 0x03, 0x72, 0x71 } },
+    { 3, decoderStep28, directionBackWard, 1, false, LocLib::protocolDcc, 3, { 0x03, 0x42, 0x41 } },
+    { 99, decoderStep28, directionForward, 28, false, LocLib::protocolXpressNet, 6, { 0xE4, 0x12, 0x00, 0x63, 0x9F, 0x0A } },
+    { 99, decoderStep28, directionForward, 28, false, LocLib::protocolDcc, 3, { 0x63, 0x7F, 0x1C } },
+    { 100, decoderStep28, directionBackWard, 0, false, LocLib::protocolDcc, 4, { 0xC0, 0x64, 0x40, 0xE4 } },
+    { 1000, decoderStep128, directionForward, 0, false, LocLib::protocolXpressNet, 6, { 0xE4, 0x13, 0xC3, 0xE8, 0x80, 0x5C } },
+    { 1000, decoderStep128, directionForward, 126, false, LocLib::protocolDcc, 5, { 0xC3, 0xE8, 0x3F, 0xFF, 0xEB } },
+    { 1000, decoderStep128, directionBackWard, 1, false, LocLib::protocolDcc, 5, { 0xC3, 0xE8, 0x3F, 0x02, 0x16 } },
+};
+
+/* Loc 3 with F0, F1, F4, F5, F8, F9, F12, F13, F20, F21, F28, F29, F36, F37, F44, F45, F52, F53, F60, F61 and F68
+ * on, the first and last function of each group. */
+static const uint8_t FunctionsOn[] = { 0, 1, 4, 5, 8, 9, 12, 13, 20, 21, 28, 29, 36, 37, 44, 45, 52, 53, 60, 61, 68 };
+
+static const CheckFunction FunctionChecks[] = {
+    { LocLib::functionGroup1, LocLib::protocolXpressNet, 6, { 0xE4, 0x20, 0x00, 0x03, 0x19, 0xDE } },
+    { LocLib::functionGroup1, LocLib::protocolDcc, 3, { 0x03, 0x99, 0x9A } },
+    { LocLib::functionGroup2, LocLib::protocolXpressNet, 6, { 0xE4, 0x21, 0x00, 0x03, 0x09, 0xCF } },
+    { LocLib::functionGroup2, LocLib::protocolDcc, 3, { 0x03, 0xB9, 0xBA } },
+    { LocLib::functionGroup3, LocLib::protocolXpressNet, 6, { 0xE4, 0x22, 0x00, 0x03, 0x09, 0xCC } },
+    { LocLib::functionGroup3, LocLib::protocolDcc, 3, { 0x03, 0xA9, 0xAA } },
+    { LocLib::functionGroup4, LocLib::protocolXpressNet, 6, { 0xE4, 0x23, 0x00, 0x03, 0x81, 0x45 } },
+    { LocLib::functionGroup4, LocLib::protocolDcc, 4, { 0x03, 0xDE, 0x81, 0x5C } },
+    { LocLib::functionGroup5, LocLib::protocolXpressNet, 6, { 0xE4, 0x28, 0x00, 0x03, 0x81, 0x4E } },
+    { LocLib::functionGroup5, LocLib::protocolDcc, 4, { 0x03, 0xDF, 0x81, 0x5D } },
+    { LocLib::functionGroup6, LocLib::protocolXpressNet, 6, { 0xE4, 0x29, 0x00, 0x03, 0x81, 0x4F } },
+    { LocLib::functionGroup6, LocLib::protocolDcc, 4, { 0x03, 0xD8, 0x81, 0x5A } },
+    { LocLib::functionGroup7, LocLib::protocolXpressNet, 6, { 0xE4, 0x2A, 0x00, 0x03, 0x81, 0x4C } },
+    { LocLib::functionGroup7, LocLib::protocolDcc, 4, { 0x03, 0xD9, 0x81, 0x5B } },
+    { LocLib::functionGroup8, LocLib::protocolXpressNet, 6, { 0xE4, 0x2B, 0x00, 0x03, 0x81, 0x4D } },
+    { LocLib::functionGroup8, LocLib::protocolDcc, 4, { 0x03, 0xDA, 0x81, 0x58 } },
+    { LocLib::functionGroup9, LocLib::protocolXpressNet, 6, { 0xE4, 0x50, 0x00, 0x03, 0x81, 0x36 } },
+    { LocLib::functionGroup9, LocLib::protocolDcc, 4, { 0x03, 0xDB, 0x81, 0x59 } },
+    { LocLib::functionGroup10, LocLib::protocolXpressNet, 6, { 0xE4, 0x51, 0x00, 0x03, 0x81, 0x37 } },
+    { LocLib::functionGroup10, LocLib::protocolDcc, 4, { 0x03, 0xDC, 0x81, 0x5E } },
+};
+
+static uint8_t FunctionAssignment[LocLib::FunctionButtons];
+static char Name[] = "check";
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * Compare an instruction with the expected packet, print both when they differ. Returns the number of failures.
+ */
+static uint16_t check_packet(
+    const char* Check, uint16_t Index, const uint8_t* Expected, uint8_t ExpectedLength, const uint8_t* Data, uint8_t Length)
+{
+    uint8_t Byte;
+    uint16_t Failed = 0;
+
+    if ((Length != ExpectedLength) || (memcmp(Data, Expected, Length) != 0))
+    {
+        printf("FAIL %s %u: expected", Check, Index);
+        for (Byte = 0; Byte < ExpectedLength; Byte++)
+        {
+            printf(" %02X", Expected[Byte]);
+        }
+        printf(", got");
+        for (Byte = 0; Byte < Length; Byte++)
+        {
+            printf(" %02X", Data[Byte]);
+        }
+        printf("\n");
+        Failed = 1;
+    }
+
+    return (Failed);
+}
+
+/***********************************************************************************************************************
+ */
+int main(void)
+{
+    LocStorage Storage;
+    LocLib Lib;
+    LocLibFunctions Functions;
+    uint8_t Data[LocLib::InstructionSizeMax];
+    uint8_t Length;
+    uint16_t Index;
+    uint16_t Failed = 0;
+
+    Storage.Init();
+    Lib.Init(Storage);
+
+    for (Index = 0; Index < sizeof(SpeedChecks) / sizeof(SpeedChecks[0]); Index++)
+    {
+        const CheckSpeed* Check = &SpeedChecks[Index];
+
+        if (Lib.CheckLoc(Check->Address) == LocLib::LocNotFound)
+        {
+            Lib.StoreLoc(Check->Address, FunctionAssignment, Name, LocLib::storeAdd);
+        }
+        Lib.UpdateLocData(Check->Address);
+        Lib.DecoderStepsUpdate(Check->Steps);
+        Lib.DirectionSet(Check->Dir);
+        Lib.SpeedUpdate(Check->Speed);
+        memset(&Functions, 0, sizeof(Functions));
+        Functions.Set(0, Check->F0);
+        Lib.FunctionsUpdate(&Functions);
+
+        Length = Lib.SpeedInstructionGet(Check->Protocol, Data);
+        Failed += check_packet("speed", Index, Check->Data, Check->Length, Data, Length);
+    }
+
+    Lib.UpdateLocData(3);
+    memset(&Functions, 0, sizeof(Functions));
+    for (Index = 0; Index < sizeof(FunctionsOn); Index++)
+    {
+        Functions.Set(FunctionsOn[Index], true);
+    }
+    Lib.FunctionsUpdate(&Functions);
+
+    for (Index = 0; Index < sizeof(FunctionChecks) / sizeof(FunctionChecks[0]); Index++)
+    {
+        const CheckFunction* Check = &FunctionChecks[Index];
+
+        Length = Lib.FunctionInstructionGet(Check->Protocol, Check->Group, Data);
+        Failed += check_packet("function", Index, Check->Data, Check->Length, Data, Length);
+    }
+
+    printf("%s: %u failed\n", (Failed == 0) ? "OK" : "FAIL", Failed);
+
+    return ((Failed == 0) ? 0 : 1);
+}
@@ -0,0 +1,290 @@
+/***********************************************************************************************************************
+   @file   LocLibImageCheck.cpp
+   @brief  Check of the images of LocLib::Export() / LocLib::Import(): round trip, older image versions and the
+           rejection of corrupted images.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Loclib.h"
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+
+/***********************************************************************************************************************
+   D E F I N E S
+ **********************************************************************************************************************/
+#define CHECK_LOCS ((LocLib::MaxNumberOfLocs < 30) ? LocLib::MaxNumberOfLocs : 30) /* Locs in the images. */
+#define CHECK_EXT_EVERY 3 /* Every third loc of an image has functions above F31 on. */
+#define CHECK_IMAGE_SIZE (12 + (LocLib::MaxNumberOfLocs * LOC_STORAGE_RECORD_SIZE_MAX) + 4)
+#define CHECK_RECORD_NAME (8 + LOC_LIB_FUNCTION_BUTTONS) /* Name in a packed record, see LocStorage.cpp. */
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+/**
+ * Image in memory, the sink of an export or the source of an import.
+ */
+struct CheckImage
+{
+    uint8_t Data[CHECK_IMAGE_SIZE];
+    uint16_t Length;   /* Bytes in the image. */
+    uint16_t Position; /* Next byte to import. */
+};
+
+static CheckImage Image;    /* Image to import. */
+static CheckImage Exported; /* Image of the last export. */
+static CheckImage Expected; /* Image an export must return. */
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * Bitwise CRC-32 (IEEE 802.3), independent of the nibble table of LocLib.
+ */
+static uint32_t check_crc(const uint8_t* Data, uint16_t Length)
+{
+    uint32_t Crc = 0xFFFFFFFF;
+    uint16_t Index;
+    uint8_t Bit;
+
+    for (Index = 0; Index < Length; Index++)
+    {
+        Crc ^= Data[Index];
+        for (Bit = 0; Bit < 8; Bit++)
+        {
+            Crc = ((Crc & 1) != 0) ? ((Crc >> 1) ^ 0xEDB88320UL) : (Crc >> 1);
+        }
+    }
+
+    return (~Crc);
+}
+
+/***********************************************************************************************************************
+ * Append the CRC of the image.
+ */
+static void check_crc_append(CheckImage* ImagePtr)
+{
+    uint32_t Crc = check_crc(ImagePtr->Data, ImagePtr->Length);
+
+    ImagePtr->Data[ImagePtr->Length++] = (uint8_t)(Crc & 0xFF);
+    ImagePtr->Data[ImagePtr->Length++] = (uint8_t)((Crc >> 8) & 0xFF);
+    ImagePtr->Data[ImagePtr->Length++] = (uint8_t)((Crc >> 16) & 0xFF);
+    ImagePtr->Data[ImagePtr->Length++] = (uint8_t)(Crc >> 24);
+}
+
+/***********************************************************************************************************************
+ * Create an image of the given version with Count locs. Images of version 3 have the name length and function
+ * buttons in the header. Every ExtEvery loc has functions above F31 on, none when ExtEvery is 0.
+ */
+static void check_image_create(CheckImage* ImagePtr, uint8_t Version, uint16_t Count, uint8_t ExtEvery)
+{
+    LocLibData Data;
+    uint16_t Index;
+    uint8_t Button;
+
+    memset(ImagePtr, 0, sizeof(CheckImage));
+    memcpy(ImagePtr->Data, "LLDB", 4);
+    ImagePtr->Data[4] = Version;
+    ImagePtr->Data[5] = LOC_STORAGE_RECORD_SIZE;
+    ImagePtr->Data[6] = 1;
+    ImagePtr->Data[7] = 1;
+    ImagePtr->Data[8] = (uint8_t)(Count & 0xFF);
+    ImagePtr->Data[9] = (uint8_t)(Count >> 8);
+    ImagePtr->Length  = 10;
+    if (Version == 3)
+    {
+        ImagePtr->Data[10] = LOC_LIB_NAME_LENGTH;
+        ImagePtr->Data[11] = LOC_LIB_FUNCTION_BUTTONS;
+        ImagePtr->Length   = 12;
+    }
+
+    /* Ascending addresses, so the list order is kept when LocLib sorts the locs. */
+    for (Index = 0; Index < Count; Index++)
+    {
+        memset(&Data, 0, sizeof(Data));
+        Data.Addres = (uint16_t)(10 + (Index * 100));
+        Data.Speed  = (uint8_t)(Index % 28);
+        Data.Dir    = ((Index % 2) == 0) ? directionForward : directionBackWard;
+        Data.Steps  = (decoderSteps)(Index % 3);
+        Data.Function.Set(0, true);
+        Data.Function.Set((uint8_t)(1 + (Index % 31)), true);
+        if ((ExtEvery != 0) && ((Index % ExtEvery) == 0))
+        {
+            Data.Function.Set((uint8_t)(32 + (Index % (LOC_LIB_FUNCTIONS - 32))), true);
+        }
+        for (Button = 0; Button < LOC_LIB_FUNCTION_BUTTONS; Button++)
+        {
+            Data.FunctionAssignment[Button] = (uint8_t)(Index + Button);
+        }
+        snprintf(Data.Name, sizeof(Data.Name), "img %u", Index);
+
+        LocStorage::RecordEncode(&Data, &ImagePtr->Data[ImagePtr->Length]);
+        ImagePtr->Length = (uint16_t)(ImagePtr->Length + LocStorage::RecordSize(&ImagePtr->Data[ImagePtr->Length]));
+    }
+
+    check_crc_append(ImagePtr);
+}
+
+/***********************************************************************************************************************
+ * Sink of an export, appends to the image.
+ */
+static bool check_export_sink(const uint8_t* Data, uint16_t Length, void* Context)
+{
+    CheckImage* ImagePtr = (CheckImage*)(Context);
+    bool Result          = false;
+
+    if ((ImagePtr->Length + Length) <= sizeof(ImagePtr->Data))
+    {
+        memcpy(&ImagePtr->Data[ImagePtr->Length], Data, Length);
+        ImagePtr->Length = (uint16_t)(ImagePtr->Length + Length);
+        Result           = true;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ * Source of an import, delivers the bytes of the image.
+ */
+static uint16_t check_import_source(uint8_t* Data, uint16_t Length, void* Context)
+{
+    CheckImage* ImagePtr = (CheckImage*)(Context);
+
+    if (Length > (ImagePtr->Length - ImagePtr->Position))
+    {
+        Length = (uint16_t)(ImagePtr->Length - ImagePtr->Position);
+    }
+    memcpy(Data, &ImagePtr->Data[ImagePtr->Position], Length);
+    ImagePtr->Position = (uint16_t)(ImagePtr->Position + Length);
+
+    return (Length);
+}
+
+/***********************************************************************************************************************
+ * Export the stored locs to Exported.
+ */
+static bool check_export(LocLib* Lib)
+{
+    memset(&Exported, 0, sizeof(Exported));
+
+    return (Lib->Export(check_export_sink, &Exported));
+}
+
+/***********************************************************************************************************************
+ * Import Image and compare the result and the number of locs afterwards with the expected ones. After a successful
+ * import the export must be equal to Expected. Returns the number of failures.
+ */
+static uint16_t check_import(LocLib* Lib, const char* Check, bool ExpectedResult, uint16_t ExpectedLocs)
+{
+    bool Result;
+    uint16_t Failed = 0;
+
+    Image.Position = 0;
+    Result         = Lib->Import(check_import_source, &Image);
+    if (Result != ExpectedResult)
+    {
+        printf("FAIL %s: import %s\n", Check, (Result == true) ? "accepted" : "rejected");
+        Failed++;
+    }
+    else if (Lib->GetNumberOfLocs() != ExpectedLocs)
+    {
+        printf("FAIL %s: expected %u locs, got %u\n", Check, ExpectedLocs, Lib->GetNumberOfLocs());
+        Failed++;
+    }
+    else if ((Result == true)
+        && ((check_export(Lib) == false) || (Exported.Length != Expected.Length)
+            || (memcmp(Exported.Data, Expected.Data, Expected.Length) != 0)))
+    {
+        printf("FAIL %s: export differs from the imported image\n", Check);
+        Failed++;
+    }
+
+    return (Failed);
+}
+
+/***********************************************************************************************************************
+ */
+int main(void)
+{
+    LocStorage Storage;
+    LocLib Lib;
+    bool Default = (LOC_LIB_NAME_LENGTH == 10) && (LOC_LIB_FUNCTION_BUTTONS == 5);
+    uint16_t Count;
+    uint16_t Failed = 0;
+
+    Storage.Init();
+    Lib.Init(Storage);
+
+    /* The reference CRC of the check itself. */
+    if (check_crc((const uint8_t*)("123456789"), 9) != 0xCBF43926UL)
+    {
+        printf("FAIL crc: reference CRC-32 wrong\n");
+        Failed++;
+    }
+
+    /* Round trip: the export of an imported image is the same image, including its CRC-32. */
+    check_image_create(&Image, 3, CHECK_LOCS, CHECK_EXT_EVERY);
+    Expected = Image;
+    Failed += check_import(&Lib, "version 3", true, CHECK_LOCS);
+    Image = Exported;
+    Failed += check_import(&Lib, "round trip", true, CHECK_LOCS);
+
+    /* Older versions only come from the default record format, they are exported as version 3. */
+    check_image_create(&Image, 2, CHECK_LOCS, CHECK_EXT_EVERY);
+    Failed += check_import(&Lib, "version 2", Default, CHECK_LOCS);
+    check_image_create(&Expected, 3, CHECK_LOCS, 0);
+    check_image_create(&Image, 1, CHECK_LOCS, 0);
+    Failed += check_import(&Lib, "version 1", Default, CHECK_LOCS);
+
+    /* An image of another record format is rejected before anything is written. */
+    check_image_create(&Image, 3, CHECK_LOCS, CHECK_EXT_EVERY);
+    Image.Data[10] = LOC_LIB_NAME_LENGTH + 1;
+    Image.Length   = (uint16_t)(Image.Length - 4);
+    check_crc_append(&Image);
+    Failed += check_import(&Lib, "name length", false, CHECK_LOCS);
+
+    check_image_create(&Image, 3, CHECK_LOCS, CHECK_EXT_EVERY);
+    Image.Data[11] = LOC_LIB_FUNCTION_BUTTONS + 1;
+    Image.Length   = (uint16_t)(Image.Length - 4);
+    check_crc_append(&Image);
+    Failed += check_import(&Lib, "function buttons", false, CHECK_LOCS);
+
+    /* A wrong CRC is found at the end, the locs in the slots of the image are removed. The locs after them remain,
+     * when none remain the initial loc is stored. */
+    check_image_create(&Image, 3, CHECK_LOCS, CHECK_EXT_EVERY);
+    Image.Data[Image.Length - 1] ^= 0x01;
+    Failed += check_import(&Lib, "crc", false, 1);
+
+    check_image_create(&Image, 3, CHECK_LOCS, CHECK_EXT_EVERY);
+    Image.Data[12 + CHECK_RECORD_NAME] ^= 0x01;
+    Failed += check_import(&Lib, "corrupted record", false, 1);
+
+    /* More locs with functions above F31 than the table of LocStorage holds. The entries of the locs after the slots
+     * of the image are still in use. */
+    Count = (uint16_t)(LOC_STORAGE_EXT_ENTRIES + 1);
+    if (Count <= LocLib::MaxNumberOfLocs)
+    {
+        check_image_create(&Image, 3, CHECK_LOCS, CHECK_EXT_EVERY);
+        Expected = Image;
+        Failed += check_import(&Lib, "before full", true, CHECK_LOCS);
+
+        check_image_create(&Image, 3, Count, 1);
+        Failed += check_import(
+            &Lib, "functions above F31 full", false, (CHECK_LOCS > Count) ? (CHECK_LOCS - Count) : 1);
+
+        /* The entries of the removed locs are free again. */
+        check_image_create(&Image, 3, CHECK_LOCS, CHECK_EXT_EVERY);
+        Failed += check_import(&Lib, "after full", true, CHECK_LOCS);
+    }
+    else
+    {
+        printf("Table of functions above F31 not checked, %u locs needed\n", Count);
+    }
+
+    printf("%s: %u failed\n", (Failed == 0) ? "OK" : "FAIL", Failed);
+
+    return ((Failed == 0) ? 0 : 1);
+}
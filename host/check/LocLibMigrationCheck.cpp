@@ -0,0 +1,264 @@
+/***********************************************************************************************************************
+   @file   LocLibMigrationCheck.cpp
+   @brief  Check of the in place conversion of the loc records of the legacy layout by LocLib::Init(), also when a
+           previous conversion was interrupted.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Loclib.h"
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+
+/***********************************************************************************************************************
+   D E F I N E S
+ **********************************************************************************************************************/
+#define CHECK_LOCS ((LocLib::MaxNumberOfLocs < 40) ? LocLib::MaxNumberOfLocs : 40) /* Locs in the legacy image. */
+#define CHECK_SELECTED ((CHECK_LOCS * 2) / 5) /* Slot of the selected loc in the legacy image. */
+
+/* Header of LocStorage, see LocStorage.cpp. */
+#define CHECK_HEADER_ADDRESS                                                                                           \
+    (LocStorageBackend::Size - LOC_STORAGE_RING_SIZE - LOC_STORAGE_SLOT_MAP_SIZE - LOC_STORAGE_HEADER_SIZE)
+#define CHECK_HEADER_LAYOUT 0
+#define CHECK_HEADER_MIGRATION 1
+#define CHECK_HEADER_NEXT_SLOT 2
+#define CHECK_HEADER_STASHED 4
+#define CHECK_HEADER_STASH 32
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+static uint8_t Image[LocStorageBackend::Size];    /* Image written before LocLib::Init(). */
+static uint8_t Migrated[LocStorageBackend::Size]; /* Image after the complete conversion. */
+static char ImageFileName[256];
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * Raw record of a loc of the legacy image.
+ */
+static void legacy_record(uint16_t Slot, LocLibDataLegacy* Legacy)
+{
+    uint8_t Button;
+
+    memset(Legacy, 0, sizeof(LocLibDataLegacy));
+    Legacy->Addres   = (uint16_t)(3 + (Slot * 37));
+    Legacy->Speed    = (uint16_t)(Slot % 28);
+    Legacy->Dir      = ((Slot % 2) == 0) ? directionForward : directionBackWard;
+    Legacy->Steps    = (decoderSteps)(Slot % 3);
+    Legacy->Function = 0x80000001UL | ((uint32_t)(Slot) << 8);
+    for (Button = 0; Button < sizeof(Legacy->FunctionAssignment); Button++)
+    {
+        Legacy->FunctionAssignment[Button] = (uint8_t)(Slot + Button);
+    }
+    snprintf(Legacy->Name, sizeof(Legacy->Name), "loc %u", Slot);
+}
+
+/***********************************************************************************************************************
+ * Create the legacy image: raw records without free slots in between, the number of locs and the selected loc at
+ * their EepCfg addresses and no LocStorage header.
+ */
+static void legacy_image(uint8_t Version)
+{
+    LocLibDataLegacy Legacy;
+    uint16_t Slot;
+
+    memset(Image, 0xFF, sizeof(Image));
+    Image[EepCfg::EepromVersionAddress]         = Version;
+    Image[EepCfg::locLibEepromAddressNumOfLocs] = CHECK_LOCS;
+    Image[EepCfg::SelectedLocAddress]           = CHECK_SELECTED;
+
+    for (Slot = 0; Slot < CHECK_LOCS; Slot++)
+    {
+        legacy_record(Slot, &Legacy);
+        memcpy(&Image[LocStorageBackend::RecordBase + (Slot * LocStorageBackend::LegacyRecordStride)], &Legacy,
+            sizeof(Legacy));
+    }
+}
+
+/***********************************************************************************************************************
+ * Create the image of a conversion interrupted before slot Next was done. The slots before Next in the direction of
+ * the conversion hold the packed records of the complete conversion. When Stashed the raw record of slot Next is in
+ * the stash and its packed record was written over it, the progress was not updated yet.
+ */
+static void interrupted_image(uint16_t Next, bool Stashed)
+{
+    bool Forward = (LocStorageBackend::RecordStride <= LocStorageBackend::LegacyRecordStride);
+    uint16_t Slot;
+    uint16_t Address;
+
+    legacy_image(EepCfg::EepromVersion);
+
+    for (Slot = 0; Slot < CHECK_LOCS; Slot++)
+    {
+        if (((Forward == true) && (Slot < Next)) || ((Forward == false) && (Slot > Next)))
+        {
+            Address = LocStorageBackend::RecordBase + (Slot * LocStorageBackend::RecordStride);
+            memcpy(&Image[Address], &Migrated[Address], LOC_STORAGE_RECORD_SIZE);
+        }
+    }
+
+    if (Stashed == true)
+    {
+        Address = LocStorageBackend::RecordBase + (Next * LocStorageBackend::LegacyRecordStride);
+        memcpy(&Image[CHECK_HEADER_ADDRESS + CHECK_HEADER_STASH], &Image[Address], sizeof(LocLibDataLegacy));
+        Address = LocStorageBackend::RecordBase + (Next * LocStorageBackend::RecordStride);
+        memcpy(&Image[Address], &Migrated[Address], LOC_STORAGE_RECORD_SIZE);
+    }
+
+    /* Progress of a conversion of the legacy layout, the layout byte is only written when the conversion is done. */
+    Image[CHECK_HEADER_ADDRESS + CHECK_HEADER_MIGRATION]     = 0;
+    Image[CHECK_HEADER_ADDRESS + CHECK_HEADER_NEXT_SLOT]     = (uint8_t)(Next & 0xFF);
+    Image[CHECK_HEADER_ADDRESS + CHECK_HEADER_NEXT_SLOT + 1] = (uint8_t)(Next >> 8);
+    Image[CHECK_HEADER_ADDRESS + CHECK_HEADER_STASHED]       = (Stashed == true) ? 1 : 0xFF;
+}
+
+/***********************************************************************************************************************
+ * Write an image file, or read it back. The file stays mapped by the host backend, so it is written in place.
+ */
+static bool image_file(uint8_t* Data, bool Write)
+{
+    FILE* File = fopen(ImageFileName, "r+b");
+    size_t Length;
+
+    if (File == NULL)
+    {
+        File = fopen(ImageFileName, "w+b");
+    }
+    if (File == NULL)
+    {
+        return (false);
+    }
+
+    if (Write == true)
+    {
+        Length = fwrite(Data, 1, LocStorageBackend::Size, File);
+    }
+    else
+    {
+        Length = fread(Data, 1, LocStorageBackend::Size, File);
+    }
+    fclose(File);
+
+    return (Length == LocStorageBackend::Size);
+}
+
+/***********************************************************************************************************************
+ * Start LocLib on the image and compare all locs and the selected loc with the legacy records. Returns the number
+ * of failures.
+ */
+static uint16_t check_locs(const char* Check)
+{
+    LocStorage Storage;
+    LocLib Lib;
+    LocLibDataLegacy Legacy;
+    LocLibData* Data;
+    uint16_t Slot;
+    uint8_t Button;
+    uint8_t Expected;
+    uint16_t Failed = 0;
+
+    if (image_file(Image, true) == false)
+    {
+        printf("FAIL %s: image file %s not written\n", Check, ImageFileName);
+        return (1);
+    }
+
+    Storage.Init();
+    Lib.Init(Storage);
+
+    if (Lib.GetNumberOfLocs() != CHECK_LOCS)
+    {
+        printf("FAIL %s: expected %u locs, got %u\n", Check, CHECK_LOCS, Lib.GetNumberOfLocs());
+        return (1);
+    }
+
+    for (Slot = 0; Slot < CHECK_LOCS; Slot++)
+    {
+        legacy_record(Slot, &Legacy);
+        Data = Lib.LocGetAllDataByIndex(Slot);
+        if ((Data->Addres != Legacy.Addres) || (Data->Speed != Legacy.Speed) || (Data->Dir != Legacy.Dir)
+            || (Data->Steps != Legacy.Steps) || (Data->Function.Low() != Legacy.Function)
+            || (strncmp(Data->Name, Legacy.Name, LOC_LIB_NAME_LENGTH) != 0))
+        {
+            printf("FAIL %s: loc %u, got address %u name %s\n", Check, Slot, Data->Addres, Data->Name);
+            Failed++;
+        }
+        for (Button = 0; Button < LocLib::FunctionButtons; Button++)
+        {
+            Expected = (Button < sizeof(Legacy.FunctionAssignment)) ? Legacy.FunctionAssignment[Button] : Button;
+            if (Data->FunctionAssignment[Button] != Expected)
+            {
+                printf("FAIL %s: loc %u, button %u assigned %u\n", Check, Slot, Button,
+                    Data->FunctionAssignment[Button]);
+                Failed++;
+            }
+        }
+    }
+
+    legacy_record(CHECK_SELECTED, &Legacy);
+    if ((Lib.GetActualSelectedLocIndex() != (CHECK_SELECTED + 1)) || (Lib.DataGet()->Addres != Legacy.Addres))
+    {
+        printf("FAIL %s: selected loc %u (%u)\n", Check, Lib.GetActualSelectedLocIndex(), Lib.DataGet()->Addres);
+        Failed++;
+    }
+
+    /* The conversion is done, the header has the packed layout and no progress. */
+    image_file(Image, false);
+    if ((Image[CHECK_HEADER_ADDRESS + CHECK_HEADER_LAYOUT] == 0xFF)
+        || (Image[CHECK_HEADER_ADDRESS + CHECK_HEADER_MIGRATION] != 0xFF))
+    {
+        printf("FAIL %s: conversion not finished\n", Check);
+        Failed++;
+    }
+
+    return (Failed);
+}
+
+/***********************************************************************************************************************
+ */
+int main(int argc, char* argv[])
+{
+    LocStorage Storage;
+    LocLib Lib;
+    uint16_t Failed = 0;
+
+    snprintf(ImageFileName, sizeof(ImageFileName), "%s/LocLibMigrationCheck.img", (argc > 1) ? argv[1] : ".");
+    remove(ImageFileName);
+    LocStorageBackendHost::ImageFileSet(ImageFileName);
+
+    printf("Records converted %s, stride %u to %u\n",
+        (LocStorageBackend::RecordStride <= LocStorageBackend::LegacyRecordStride) ? "forward" : "backward",
+        LocStorageBackend::LegacyRecordStride, LocStorageBackend::RecordStride);
+
+    legacy_image(EepCfg::EepromVersion);
+    Failed += check_locs("legacy layout");
+    image_file(Migrated, false);
+
+    /* Interrupted after the raw record of slot 0, which overlaps its own packed record, was stashed. */
+    interrupted_image(0, true);
+    Failed += check_locs("interrupted stashed");
+
+    /* Interrupted halfway, the slots before the middle in the direction of the conversion are done. */
+    interrupted_image(CHECK_LOCS / 2, false);
+    Failed += check_locs("interrupted halfway");
+
+    /* Without header the legacy locs of another EEPROM version can not be identified, they are erased. */
+    legacy_image(EepCfg::EepromVersion - 1);
+    image_file(Image, true);
+    Storage.Init();
+    Lib.Init(Storage);
+    if (Lib.GetNumberOfLocs() != 1)
+    {
+        printf("FAIL other version: expected 1 loc, got %u\n", Lib.GetNumberOfLocs());
+        Failed++;
+    }
+
+    printf("%s: %u failed\n", (Failed == 0) ? "OK" : "FAIL", Failed);
+
+    return ((Failed == 0) ? 0 : 1);
+}
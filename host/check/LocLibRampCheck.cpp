@@ -0,0 +1,117 @@
+/***********************************************************************************************************************
+   @file   LocLibRampCheck.cpp
+   @brief  Check of the momentum of LocLib, the pacing of the speed by Tick().
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Loclib.h"
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+
+/***********************************************************************************************************************
+   D E F I N E S
+ **********************************************************************************************************************/
+#define CHECK_RAMP_TIME 10000 /* Ramp time in ms, with 28 decoder steps a step takes 357 ms. */
+#define CHECK_TIME_START 60000 /* Time of the first tick, long after the start of the time base. */
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+static uint8_t FunctionAssignment[LocLib::FunctionButtons];
+static char Name[] = "ramp";
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * Print a failed check. Returns the number of failures.
+ */
+static uint16_t check_speed(const char* Check, uint8_t Expected, uint8_t Speed)
+{
+    uint16_t Failed = 0;
+
+    if (Speed != Expected)
+    {
+        printf("FAIL %s: expected speed %u, got %u\n", Check, Expected, Speed);
+        Failed = 1;
+    }
+
+    return (Failed);
+}
+
+/***********************************************************************************************************************
+ */
+int main(void)
+{
+    LocStorage Storage;
+    LocLib Lib;
+    uint32_t Now = CHECK_TIME_START;
+    uint8_t Step;
+    uint8_t Active;
+    uint16_t Failed = 0;
+
+    Storage.Init();
+    Lib.Init(Storage);
+    Lib.DecoderStepsUpdate(decoderStep28);
+    Lib.DirectionSet(directionForward);
+    Lib.SpeedUpdate(0);
+
+    /* First tick of a ramp, the time before the ramp started is not counted. */
+    Lib.RampSet(CHECK_RAMP_TIME, CHECK_RAMP_TIME);
+    for (Step = 0; Step < 5; Step++)
+    {
+        Lib.SpeedSet(1);
+    }
+    Lib.Tick(Now);
+    Failed += check_speed("first tick", 0, Lib.SpeedGet());
+
+    /* 1000 ms are 2.8 steps, the rest is kept for the next tick. */
+    Now += 1000;
+    Lib.Tick(Now);
+    Failed += check_speed("acceleration 1000 ms", 2, Lib.SpeedGet());
+    Now += 100;
+    Lib.Tick(Now);
+    Failed += check_speed("acceleration 1100 ms", 3, Lib.SpeedGet());
+    Now += 900;
+    Lib.Tick(Now);
+    Failed += check_speed("acceleration 2000 ms", 5, Lib.SpeedGet());
+
+    /* Ramp down in ticks of 50 ms, 5 steps take 1786 ms. */
+    Lib.SpeedSet(0);
+    Lib.Tick(Now);
+    Now += 1750;
+    Lib.Tick(Now);
+    Failed += check_speed("deceleration 1750 ms", 1, Lib.SpeedGet());
+    Now += 50;
+    Lib.Tick(Now);
+    Failed += check_speed("deceleration 1800 ms", 0, Lib.SpeedGet());
+
+    /* A ramp started after a long time without ticks starts at its first tick. */
+    Now += 60000;
+    Lib.SpeedSet(1);
+    Lib.Tick(Now);
+    Failed += check_speed("restart first tick", 0, Lib.SpeedGet());
+    Now += 400;
+    Lib.Tick(Now);
+    Failed += check_speed("restart 400 ms", 1, Lib.SpeedGet());
+
+    /* A loc added to the active locs gets the momentum, its first tick counts no time either. */
+    Lib.StoreLoc(10, FunctionAssignment, Name, LocLib::storeAddNoAutoSelect);
+    Now += 60000;
+    Active = Lib.ActiveLocAdd(10);
+    Lib.RampSet(CHECK_RAMP_TIME, CHECK_RAMP_TIME);
+    Lib.SpeedSet(1);
+    Lib.Tick(Now);
+    Failed += check_speed("added loc first tick", 0, Lib.ActiveLocDataGet(Active)->Speed);
+    Now += 400;
+    Lib.Tick(Now);
+    Failed += check_speed("added loc 400 ms", 1, Lib.ActiveLocDataGet(Active)->Speed);
+
+    printf("%s: %u failed\n", (Failed == 0) ? "OK" : "FAIL", Failed);
+
+    return ((Failed == 0) ? 0 : 1);
+}
@@ -0,0 +1,27 @@
+/**
+ **********************************************************************************************************************
+ * @file  eep_cfg.h
+ * @brief EEPROM layout for building LocLib on a host (Linux) system. To use EEPROM dumps of a device build with
+ *        CFG_DIR pointing to the directory with the eep_cfg.h of the device application.
+ ***********************************************************************************************************************
+ */
+
+#ifndef EEP_CFG_H
+#define EEP_CFG_H
+
+namespace EepCfg
+{
+const int EepromVersion                = 3;
+const int EepromVersionAddress         = 0;
+const int AcTypeControlAddress         = 1;
+const int SelectedLocAddress           = 2;
+const int XpNetAddress                 = 3;
+const int EmergencyStopEnabledAddress  = 4;
+const int ButtonAdcValuesAddressValid  = 5;
+const int locLibEepromAddressNumOfLocs = 16;
+const int locLibEepromAddressData      = 256;
+const int locLibEepromAddressLocData   = 256;
+const int EepromPageSize               = 64;
+}
+
+#endif
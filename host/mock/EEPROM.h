@@ -0,0 +1,24 @@
+/**
+ **********************************************************************************************************************
+ * @file  EEPROM.h
+ * @brief Emulated ESP8266 EEPROM, a RAM mirror of a flash sector.
+ ***********************************************************************************************************************
+ */
+
+#ifndef MOCK_EEPROM_H
+#define MOCK_EEPROM_H
+
+#include <Arduino.h>
+
+class EEPROMClass
+{
+public:
+    void begin(size_t size);
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    bool commit(void);
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,280 @@
+/***********************************************************************************************************************
+   @file   MockHw.cpp
+   @brief  Emulated AT24C256 (Wire) and ESP8266 flash (EEPROM) with access counters and a modeled clock.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "MockHw.h"
+#include "EEPROM.h"
+#include "Wire.h"
+#include "spi_flash.h"
+#include <Arduino.h>
+
+/***********************************************************************************************************************
+   D E F I N E S
+ **********************************************************************************************************************/
+#define MOCK_HW_AT24C256_ADDRESS 0x50
+#define MOCK_HW_AT24C256_SIZE 32768
+#define MOCK_HW_AT24C256_PAGE_SIZE 64
+#define MOCK_HW_FLASH_SIZE SPI_FLASH_SEC_SIZE /* The core limits the emulated EEPROM to one sector. */
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+TwoWire Wire;
+EEPROMClass EEPROM;
+
+static MockHwStats Stats;
+static uint64_t Now;                                   /* Modeled time in us. */
+static uint8_t At24c256[MOCK_HW_AT24C256_SIZE];        /* EEPROM content. */
+static uint16_t At24c256Pointer;                       /* Internal address counter of the EEPROM. */
+static uint64_t At24c256BusyUntil;                     /* End of running write cycle. */
+static int WireDevice;                                 /* Device address of actual transfer. */
+static uint8_t WireTx[BUFFER_LENGTH];                  /* Transmit buffer. */
+static uint8_t WireTxLength;                           /* Bytes in transmit buffer. */
+static uint8_t WireRx[BUFFER_LENGTH];                  /* Receive buffer. */
+static uint8_t WireRxLength;                           /* Bytes in receive buffer. */
+static uint8_t WireRxPosition;                         /* Next byte to read from receive buffer. */
+static uint8_t Flash[MOCK_HW_FLASH_SIZE];              /* RAM mirror of the flash. */
+static size_t FlashSize = MOCK_HW_FLASH_SIZE;          /* Size given to EEPROM.begin(). */
+static bool Erased;                                    /* Memories initialized. */
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * Advance the modeled time.
+ */
+static void mock_hw_time_add(uint64_t Us)
+{
+    Now += Us;
+    Stats.TimeUs += Us;
+}
+
+/***********************************************************************************************************************
+ * Count an I2C transfer of the given number of bytes after the device address.
+ */
+static void mock_hw_i2c_transfer(uint16_t Bytes)
+{
+    /* Each byte takes 9 clocks including the acknowledge, plus start and stop condition. */
+    Stats.I2cTransactions++;
+    Stats.I2cBytes += 1 + Bytes;
+    mock_hw_time_add(((((uint64_t)(1 + Bytes) * 9) + 2) * MOCK_HW_I2C_BIT_TIME_NS + 999) / 1000);
+}
+
+/***********************************************************************************************************************
+ */
+void MockHwErase(void)
+{
+    memset(At24c256, 0xFF, sizeof(At24c256));
+    memset(Flash, 0xFF, sizeof(Flash));
+    At24c256Pointer   = 0;
+    At24c256BusyUntil = 0;
+    Erased            = true;
+}
+
+/***********************************************************************************************************************
+ */
+void MockHwStatsGet(MockHwStats* StatsPtr) { memcpy(StatsPtr, &Stats, sizeof(MockHwStats)); }
+
+/***********************************************************************************************************************
+ */
+void MockHwStatsReset(void) { memset(&Stats, 0, sizeof(MockHwStats)); }
+
+/***********************************************************************************************************************
+ */
+unsigned long millis(void)
+{
+    mock_hw_time_add(MOCK_HW_CPU_US_PER_CALL);
+    return ((unsigned long)(Now / 1000));
+}
+
+/***********************************************************************************************************************
+ */
+unsigned long micros(void)
+{
+    mock_hw_time_add(MOCK_HW_CPU_US_PER_CALL);
+    return ((unsigned long)(Now));
+}
+
+/***********************************************************************************************************************
+ */
+void delay(unsigned long ms) { mock_hw_time_add((uint64_t)(ms) * 1000); }
+
+/***********************************************************************************************************************
+ */
+void TwoWire::begin(void)
+{
+    if (Erased == false)
+    {
+        MockHwErase();
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void TwoWire::beginTransmission(int address)
+{
+    WireDevice   = address;
+    WireTxLength = 0;
+}
+
+/***********************************************************************************************************************
+ */
+size_t TwoWire::write(uint8_t data)
+{
+    size_t Result = 0;
+
+    if (WireTxLength < BUFFER_LENGTH)
+    {
+        WireTx[WireTxLength++] = data;
+        Result                 = 1;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ * Transmit the buffer. During a write cycle the EEPROM does not acknowledge its address.
+ */
+uint8_t TwoWire::endTransmission(void)
+{
+    uint8_t Result = 0;
+    uint8_t Index;
+    uint16_t Page;
+
+    if ((WireDevice != MOCK_HW_AT24C256_ADDRESS) || (Now < At24c256BusyUntil))
+    {
+        mock_hw_i2c_transfer(0);
+        Result = 2;
+    }
+    else
+    {
+        mock_hw_i2c_transfer(WireTxLength);
+        if (WireTxLength >= 2)
+        {
+            At24c256Pointer = (uint16_t)((((uint16_t)(WireTx[0]) << 8) | WireTx[1]) % MOCK_HW_AT24C256_SIZE);
+        }
+        if (WireTxLength > 2)
+        {
+            /* Data rolls over within the page. */
+            Page = At24c256Pointer - (At24c256Pointer % MOCK_HW_AT24C256_PAGE_SIZE);
+            for (Index = 2; Index < WireTxLength; Index++)
+            {
+                At24c256[Page + ((At24c256Pointer + Index - 2) % MOCK_HW_AT24C256_PAGE_SIZE)] = WireTx[Index];
+            }
+            Stats.PageWrites++;
+            At24c256BusyUntil = Now + MOCK_HW_I2C_WRITE_CYCLE_US;
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ * Sequential read from the internal address counter.
+ */
+uint8_t TwoWire::requestFrom(int address, int quantity)
+{
+    uint8_t Index;
+
+    WireRxLength   = 0;
+    WireRxPosition = 0;
+
+    if (quantity > BUFFER_LENGTH)
+    {
+        quantity = BUFFER_LENGTH;
+    }
+
+    if ((address != MOCK_HW_AT24C256_ADDRESS) || (Now < At24c256BusyUntil))
+    {
+        mock_hw_i2c_transfer(0);
+    }
+    else
+    {
+        mock_hw_i2c_transfer((uint16_t)(quantity));
+        for (Index = 0; Index < quantity; Index++)
+        {
+            WireRx[Index]   = At24c256[At24c256Pointer];
+            At24c256Pointer = (At24c256Pointer + 1) % MOCK_HW_AT24C256_SIZE;
+        }
+        WireRxLength = (uint8_t)(quantity);
+    }
+
+    return (WireRxLength);
+}
+
+/***********************************************************************************************************************
+ */
+int TwoWire::available(void) { return (WireRxLength - WireRxPosition); }
+
+/***********************************************************************************************************************
+ */
+int TwoWire::read(void)
+{
+    int Result = -1;
+
+    if (WireRxPosition < WireRxLength)
+    {
+        Result = WireRx[WireRxPosition++];
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+void EEPROMClass::begin(size_t size)
+{
+    if (Erased == false)
+    {
+        MockHwErase();
+    }
+
+    FlashSize = size;
+    if (FlashSize > sizeof(Flash))
+    {
+        FlashSize = sizeof(Flash);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t EEPROMClass::read(int address)
+{
+    uint8_t Result = 0; /* As the core, outside the emulated EEPROM. */
+
+    if ((address >= 0) && ((size_t)(address) < FlashSize))
+    {
+        Result = Flash[address];
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+void EEPROMClass::write(int address, uint8_t value)
+{
+    if ((address >= 0) && ((size_t)(address) < FlashSize))
+    {
+        Flash[address] = value;
+    }
+}
+
+/***********************************************************************************************************************
+ * The whole RAM mirror is written back, each sector is erased and programmed.
+ */
+bool EEPROMClass::commit(void)
+{
+    size_t Sectors = (FlashSize + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE;
+
+    Stats.FlashCommits++;
+    Stats.FlashBytes += FlashSize;
+    mock_hw_time_add((Sectors * MOCK_HW_FLASH_ERASE_US) + ((FlashSize * MOCK_HW_FLASH_WRITE_US_PER_KB) / 1024));
+
+    return (true);
+}
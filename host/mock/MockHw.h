@@ -0,0 +1,50 @@
+/**
+ **********************************************************************************************************************
+ * @file  MockHw.h
+ * @brief Emulated AT24C256 (Wire) and ESP8266 flash (EEPROM) with access counters and a modeled clock.
+ ***********************************************************************************************************************
+ */
+
+#ifndef MOCK_HW_H
+#define MOCK_HW_H
+
+#include <Arduino.h>
+
+/**
+ * Modeled duration of hardware actions.
+ */
+#define MOCK_HW_I2C_BIT_TIME_NS 2500        /* 400 kHz I2C clock. */
+#define MOCK_HW_I2C_WRITE_CYCLE_US 5000     /* AT24C256 page write cycle. */
+#define MOCK_HW_FLASH_ERASE_US 45000        /* ESP8266 sector erase. */
+#define MOCK_HW_FLASH_WRITE_US_PER_KB 2500  /* ESP8266 flash programming. */
+#define MOCK_HW_CPU_US_PER_CALL 1           /* Every millis() / micros() call, keeps polling loops finite. */
+
+/**
+ * Counted hardware accesses since the last MockHwStatsReset().
+ */
+struct MockHwStats
+{
+    uint32_t I2cTransactions; /* Address phases (write transfers and read requests). */
+    uint32_t I2cBytes;        /* Bytes on the bus including device and memory addresses. */
+    uint32_t PageWrites;      /* Started EEPROM write cycles. */
+    uint32_t FlashCommits;    /* EEPROM.commit() calls which rewrote the flash. */
+    uint32_t FlashBytes;      /* Bytes programmed in flash by the commits. */
+    uint64_t TimeUs;          /* Modeled time. */
+};
+
+/**
+ * Erase the emulated memories, all bytes 0xFF.
+ */
+void MockHwErase(void);
+
+/**
+ * Get the counters.
+ */
+void MockHwStatsGet(MockHwStats* Stats);
+
+/**
+ * Clear the counters.
+ */
+void MockHwStatsReset(void);
+
+#endif
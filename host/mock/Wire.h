@@ -0,0 +1,29 @@
+/**
+ **********************************************************************************************************************
+ * @file  Wire.h
+ * @brief Emulated I2C bus with an AT24C256 EEPROM.
+ ***********************************************************************************************************************
+ */
+
+#ifndef MOCK_WIRE_H
+#define MOCK_WIRE_H
+
+#include <Arduino.h>
+
+#define BUFFER_LENGTH 32
+
+class TwoWire
+{
+public:
+    void begin(void);
+    void beginTransmission(int address);
+    size_t write(uint8_t data);
+    uint8_t endTransmission(void);
+    uint8_t requestFrom(int address, int quantity);
+    int available(void);
+    int read(void);
+};
+
+extern TwoWire Wire;
+
+#endif
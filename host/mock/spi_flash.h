@@ -0,0 +1,13 @@
+/**
+ **********************************************************************************************************************
+ * @file  spi_flash.h
+ * @brief Emulated ESP8266 flash definitions.
+ ***********************************************************************************************************************
+ */
+
+#ifndef MOCK_SPI_FLASH_H
+#define MOCK_SPI_FLASH_H
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+#endif